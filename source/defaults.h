@@ -13,4 +13,13 @@
 #define CD_PREPARER_ID    " "
 #define CD_APPLICATION_ID "CDI/CDI_VCD.APP;1"
 
-#define ISO_FS_BLOCKS 900
+/* Minimum size of the first track (ISO 9660 file system) in blocks,
+   it is enlarged as needed. A track must last at least 4 seconds */
+
+#define ISO_FS_BLOCKS 300
+
+/* Memory for the video data in the multiplexer (vcdmplex, mkvcdfs --mux)
+   at most. The video stream is read that far ahead, bigger frames are
+   multiplexed while they are read */
+
+#define MAX_VIDEO_BUFFER (2*1024*1024)
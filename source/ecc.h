@@ -73,6 +73,13 @@ int decode_L2_Q(unsigned char inout[4 + L2_RAW + 12 + L2_Q]);
 int decode_L2_P(unsigned char inout[4 + L2_RAW + 12 + L2_Q + L2_P]);
 unsigned int build_edc(unsigned char inout[], int from, int upto);
 
+/* incremental update of a MODE_2_FORM_1 or MODE_2_FORM_2 sector encoded
+   by do_encode_L2(): the len bytes at offset (subheader or user data)
+   are replaced by data, EDC and P/Q parity are updated from the changed
+   bytes only. Returns -1 if the sector type or range is not supported. */
+int update_L2(unsigned char inout[], int sectortype, int offset,
+		unsigned char *data, int len);
+
 /* generates f2 frames from otherwise fully formatted sectors (generated by
    do_encode_L2()). */
 int scramble_L2(unsigned char *inout);
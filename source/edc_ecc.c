@@ -584,6 +584,114 @@ int do_encode_L2(unsigned char inout[(12 + 4 + L2_RAW+4+8+L2_Q+L2_P)], int secto
   return 0;
 }
 
+/* Incremental update of encoded sectors.
+   EDC (a CRC without start value) and the P/Q parity (linear over
+   GF(2^8)) of the XOR of two sectors are the XOR of their EDC and
+   parity, so only the changed bytes need to be looked at. */
+
+static unsigned char gf_mul(unsigned char data, unsigned char coeff_log)
+{
+  unsigned int sum = rs_l12_log[data] + coeff_log;
+
+  if (sum >= ((1 << RS_L12_BITS)-1))
+    sum -= (1 << RS_L12_BITS)-1;
+  return rs_l12_alog[sum];
+}
+
+/* add the P parity of the delta byte at pos (counted from the header) */
+static void update_L2_P(unsigned char inout[4 + L2_RAW + 4 + 8 + L2_P],
+		unsigned char delta[4 + L2_RAW + 4 + 8 + L2_P], int pos)
+{
+  unsigned char *P = inout + 4 + L2_RAW + 4 + 8;
+  unsigned char *dP = delta + 4 + L2_RAW + 4 + 8;
+  int i = pos / (2*43);          /* row */
+  int j = pos % (2*43);          /* column (LSB/MSB) */
+  unsigned char d;
+
+  d = gf_mul(delta[pos], DP[0][i]);
+  P[j] ^= d;
+  dP[j] ^= d;
+  d = gf_mul(delta[pos], DP[1][i]);
+  P[43*2+j] ^= d;
+  dP[43*2+j] ^= d;
+}
+
+/* add the Q parity of the delta byte at pos (counted from the header) */
+static void update_L2_Q(unsigned char inout[4 + L2_RAW + 4 + 8 + L2_P + L2_Q],
+		unsigned char delta[4 + L2_RAW + 4 + 8 + L2_P], int pos)
+{
+  unsigned char *Q = inout + 4 + L2_RAW + 4 + 8 + L2_P;
+  int w = pos >> 1;              /* 16 bit unit */
+  int i = w % 43;                /* column */
+  int j;
+
+  /* see encode_L2_Q(): unit j*43+i*44 (mod 26*43) belongs to diagonal j */
+  j = (w / 43 + 26 - i % 26) % 26;
+
+  Q[j*2 + (pos & 1)]      ^= gf_mul(delta[pos], DQ[0][i]);
+  Q[26*2 + j*2 + (pos & 1)] ^= gf_mul(delta[pos], DQ[1][i]);
+}
+
+int update_L2(unsigned char inout[], int sectortype, int offset,
+		unsigned char *data, int len)
+{
+  static unsigned char delta[12 + 4 + L2_RAW + 12 + L2_Q + L2_P];
+  unsigned int result;
+  int edc_pos, pos, first, last;
+
+  switch (sectortype) {
+    case MODE_2_FORM_1:
+	edc_pos = 16+8+2048;
+	break;
+    case MODE_2_FORM_2:
+	edc_pos = 16+8+2324;
+	break;
+    default:
+	return -1;
+  }
+  if (offset < 16 || len < 0 || offset+len > edc_pos)
+	return -1;
+
+  /* the XOR delta of the bytes changed */
+  first = last = -1;
+  for (pos = offset; pos < offset+len; pos++) {
+	delta[pos] = inout[pos] ^ data[pos-offset];
+	if (delta[pos] != 0) {
+		if (first < 0) first = pos;
+		last = pos;
+	}
+	inout[pos] = data[pos-offset];
+  }
+  if (first < 0)
+	return 0;
+
+  /* leading zeros leave the EDC of the delta 0 */
+  memset(delta+last+1, 0, edc_pos-(last+1));
+  result = build_edc(delta, first, edc_pos-1);
+  delta[edc_pos+0] = result >> 0L;
+  delta[edc_pos+1] = result >> 8L;
+  delta[edc_pos+2] = result >> 16L;
+  delta[edc_pos+3] = result >> 24L;
+  for (pos = edc_pos; pos < edc_pos+4; pos++)
+	inout[pos] ^= delta[pos];
+
+  if (sectortype == MODE_2_FORM_1) {
+	/* P from the data and EDC, Q from these and P */
+	memset(delta + 12 + 4 + L2_RAW + 4 + 8, 0, L2_P);
+	for (pos = first; pos <= last; pos++)
+		if (delta[pos] != 0) update_L2_P(inout+12, delta+12, pos-12);
+	for (pos = edc_pos; pos < edc_pos+4; pos++)
+		if (delta[pos] != 0) update_L2_P(inout+12, delta+12, pos-12);
+
+	for (pos = first; pos <= last; pos++)
+		if (delta[pos] != 0) update_L2_Q(inout+12, delta+12, pos-12);
+	for (pos = edc_pos; pos < 12 + 4 + L2_RAW + 4 + 8 + L2_P; pos++)
+		if (delta[pos] != 0) update_L2_Q(inout+12, delta+12, pos-12);
+  }
+
+  return 0;
+}
+
 static int do_decode_L2(unsigned char in[(L2_RAW+L2_Q+L2_P)],
 		unsigned char out[L2_RAW])
 {
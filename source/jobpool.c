@@ -0,0 +1,118 @@
+/*
+    jobpool: run independent jobs in a pool of worker processes
+
+    The VCD tools keep their state in static variables and terminate
+    with exit() on fatal errors, so every job runs in a process of its
+    own. A failing job can not take down the others this way.
+
+    Copyright (C) 2026 The VCD-Tools contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "jobpool.h"
+
+int num_cpus(void)
+{
+   long n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+   n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+   return (n<1) ? 1 : (int) n;
+}
+
+int run_jobs(int njobs, int nworkers, int (*job)(int n), int *status)
+{
+   int next, running, failed, st, n;
+   pid_t pid, *pids;
+
+   if(nworkers<1) nworkers = 1;
+   if(nworkers>njobs) nworkers = njobs;
+
+   pids = (pid_t *) malloc(njobs*sizeof(pid_t));
+   if(pids==0)
+   {
+      fprintf(stderr,"Out of memory in run_jobs\n");
+      exit(1);
+   }
+
+   next = running = failed = 0;
+
+   if(status) for(n=0;n<njobs;n++) status[n] = -1;
+
+   while(next<njobs || running>0)
+   {
+      /* Hand out jobs as long as there are free workers */
+
+      if(next<njobs && running<nworkers)
+      {
+         /* Output buffered so far must not be duplicated in the child */
+
+         fflush(stdout);
+         fflush(stderr);
+
+         pid = fork();
+         if(pid<0)
+         {
+            perror("fork");
+            fprintf(stderr,"Can not start job %d\n",next);
+            failed += njobs-next;
+            next = njobs;
+            continue;
+         }
+         if(pid==0)
+         {
+            st = job(next);
+            fflush(stdout);
+            exit(st);
+         }
+
+         pids[next++] = pid;
+         running++;
+         continue;
+      }
+
+      /* All workers busy, wait for one of them */
+
+      pid = wait(&st);
+      if(pid<0)
+      {
+         perror("wait");
+         break;
+      }
+      running--;
+
+      for(n=0;n<next;n++) if(pids[n]==pid) break;
+
+      if(status && n<next) status[n] = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+
+      if(!WIFEXITED(st) || WEXITSTATUS(st)!=0)
+      {
+         fprintf(stderr,"Job %d failed\n",n+1);
+         failed++;
+      }
+   }
+
+   free(pids);
+
+   return failed;
+}
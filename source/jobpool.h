@@ -0,0 +1,16 @@
+/* Simple process pool for running independent jobs in parallel */
+
+/* number of processors online (at least 1) */
+int num_cpus(void);
+
+/* run_jobs: call job(n) for n = 0 ... njobs-1, each in a child process,
+             with at most nworkers children running at the same time.
+             A job is handed out as soon as a worker gets free, so long
+             and short jobs mix without leaving processors idle.
+             The return value of job() (or the exit code if the job
+             calls exit()) is the status of that job, 0 means success.
+             If status is not 0, status[n] is set to the status of job n
+             (-1 if it was killed by a signal or could not be started).
+
+   returns the number of failed jobs */
+int run_jobs(int njobs, int nworkers, int (*job)(int n), int *status);
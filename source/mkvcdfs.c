@@ -4,13 +4,101 @@
 
     Usage:
 
-      mkvcdfs mpegfile1 mpegfile2 ....
+      mkvcdfs [-o image] [-t toc] [-V volume-id] mpegfile1 mpegfile2 ....
 
     mkvcdfs creates 2 files:
 
     vcd.toc          contains the table of contents of the VCD
     vcd_image.bin    contains the CD-Image itself
 
+    (other names may be given with -o and -t).
+
+    -f adds a file or a directory tree to the ISO file system
+    (may be given several times).
+
+    ENTRIES.VCD has an entry point at the start of every track. With
+    -e secs more entry points are added at the start of a GOP every
+    secs seconds (by PTS), so players can skip within a track. The
+    500 entries possible are shared by the tracks according to their
+    size.
+
+    -s adds EXT/SCANDATA.DAT with the sector of every I frame (at most
+    2 per second of MPEG data) for fast forward and reverse. The I frames
+    are found while the tracks are copied, no extra pass is needed.
+
+    All time stamps of the file system are set to the current time,
+    or to --source-date-epoch secs (default: environment variable
+    SOURCE_DATE_EPOCH) if given. Identical input then gives an
+    identical image and toc file.
+
+    With --stats file a report about the sectors written and the time
+    spent for parsing, encoding, writing and the ISO file system is
+    written to file (one line of JSON per disc, "-" is stdout).
+
+    Mux mode:
+
+      mkvcdfs --mux [options as above] video1 audio1 video2 audio2 ....
+
+    multiplexes the MPEG video and audio streams of every track like
+    vcdmplex (see mplex.c) and encodes the packs right away, without
+    writing or parsing a system stream. The streams may be pipes or
+    "-" (stdin).
+
+    Batch mode:
+
+      mkvcdfs -b jobfile [-j workers]
+
+    masters all discs described in jobfile (see read_job_file() below),
+    using one worker process per processor unless -j is given.
+    -o, -t, -V and -f can not be used with -b, the job file gives
+    them for every disc.
+
+    With --variants the discs are mastered one after the other instead.
+    A track on several discs (same MPEG file, for example discs with
+    other volume ids, track orders or a bonus track) is parsed and
+    encoded only for the first one, the other discs copy the encoded
+    sectors from its image (see copy_track() below).
+
+    Split mode:
+
+      mkvcdfs --plan minutes [--keep-order] [--dry-run] mpegfile1 ....
+
+    distributes the MPEG files over the fewest discs of the given
+    capacity (74 or 80 for the usual CDR) and masters these discs like
+    batch mode. The number of the disc is appended to the image and toc
+    names (vcd_image_1.bin, vcd_1.toc, ...), -f files go to every disc.
+    --keep-order fills the discs in the order of the files given,
+    --dry-run only prints the plan (see plan_discs() below) and the
+    geometry of the discs.
+
+    Dry run:
+
+      mkvcdfs --dry-run [options as above] mpegfile1 ....
+
+    writes only the toc file and prints the geometry of the image
+    (sectors and MSF of the tracks, total size) as one line of JSON,
+    no sector is encoded or written. The sizes of the tracks are taken
+    from the MPEG files (see dry_run_disc() below). --dry-run may be
+    given with -b as well.
+
+    Preflight:
+
+      mkvcdfs --preflight [-j workers] mpegfile1 ....
+      mkvcdfs --preflight [-j workers] -b jobfile
+
+    only parses the MPEG files (or all tracks of the job file) in
+    parallel and reports every file that can not be mastered.
+
+    Patch mode:
+
+      mkvcdfs --patch image [-V volume-id] [--album id] [--volume n/count]
+              [--entry n=sector] ...
+
+    changes the volume id, the album id and volume number in INFO.VCD
+    or moves entry point n (counted from 1) of ENTRIES.VCD to another
+    sector of its track in a finished image. Only the sectors holding
+    these are rewritten (see patch_image() below).
+
 
     Copyright (C) 2000 Rainer Johanni <Rainer@Johanni.de>
 
@@ -30,40 +118,178 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
 #include "defaults.h"
 #include "ecc.h"
+#include "mkvcdfs.h"
+#include "jobpool.h"
+#include "mplex.h"
+
+#define BCD(x)      ( ((x)/10)*16 + (x)%10 )
+#define FROM_BCD(x) ( (((x)>>4)&0xf)*10 + ((x)&0xf) )
 
 static int maxrec = 0;
 static int xa_fd;
 
-static unsigned char outrec[2352];
+/* Records are collected and written with one write() call
+   as long as they follow each other */
+
+#define WRITE_BATCH 64
+
+static unsigned char batch[WRITE_BATCH*2352];
+static int batch_rec, batch_len;
+
+static unsigned char *outrec = batch;
+
+/* Statistics, only collected if a report is wanted (--stats) */
+
+static char *stats_file;
+
+static struct {
+   double t_parse, t_encode, t_write, t_iso, t_total;
+   long   sec_video, sec_audio, sec_padding, sec_empty, sec_iso;
+   double bytes_read, bytes_written;
+} stats;
 
-static void write_record(int rec)
+/* The class of every record written, a record written again (the gaps
+   are filled with zero records first) is counted as the last one */
+
+#define SEC_EMPTY   1
+#define SEC_ISO     2
+#define SEC_VIDEO   3
+#define SEC_AUDIO   4
+#define SEC_PADDING 5
+
+static unsigned char *sec_class;
+static int max_sec_class;
+
+static double now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv,0);
+   return tv.tv_sec + tv.tv_usec*1.0e-6;
+}
+
+static void encode_record(int sectortype, int rec)
+{
+   double t0 = 0;
+
+   if(stats_file) t0 = now();
+
+   do_encode_L2(outrec, sectortype, rec+150);
+
+   if(stats_file) stats.t_encode += now()-t0;
+}
+
+static void flush_records()
 {
    int n;
+   double t0 = 0;
+
+   if(batch_len==0) return;
 
-   lseek(xa_fd,rec*2352,SEEK_SET);
-   n = write(xa_fd,outrec,2352);
+   if(stats_file) t0 = now();
 
-   if(n!=2352)
+   lseek(xa_fd,(off_t)batch_rec*2352,SEEK_SET);
+   n = write(xa_fd,batch,batch_len*2352);
+
+   if(n!=batch_len*2352)
    {
       fprintf(stderr,"Error writing to binary MPEG output file\n");
       perror("write");
       exit(1);
    }
+
+   if(stats_file) stats.t_write += now()-t0;
+
+   batch_len = 0;
+}
+
+static void start_record(int rec)
+{
+   /* Let outrec point to the place for record rec */
+
+   if(batch_len>0 && (rec!=batch_rec+batch_len || batch_len==WRITE_BATCH))
+      flush_records();
+
+   if(batch_len==0) batch_rec = rec;
+
+   outrec = batch + batch_len*2352;
+}
+
+static void write_record(int rec, int class)
+{
+   int n;
+
+   batch_len++;
+
+   if(!stats_file) return;
+
+   if(rec>=max_sec_class)
+   {
+      n = max_sec_class;
+      max_sec_class = (rec>=2*n) ? rec+4096 : 2*n;
+      sec_class = (unsigned char *) realloc(sec_class, max_sec_class);
+      if(sec_class==0)
+      {
+         fprintf(stderr,"Out of memory\n");
+         exit(1);
+      }
+      memset(sec_class+n, 0, max_sec_class-n);
+   }
+   sec_class[rec] = class;
+}
+
+static int form2_class(int h2, int h3)
+{
+   /* By subheader: video, audio, other MPEG data (padding)
+      and empty sectors in the gaps around the MPEG data */
+
+   if(h3 & 0x02) return SEC_VIDEO;
+   if(h3 & 0x04) return SEC_AUDIO;
+   if(h2 == 1)   return SEC_PADDING;
+   return SEC_EMPTY;
+}
+
+static void count_records()
+{
+   /* The statistics of the records of the image */
+
+   int rec;
+
+   stats.sec_video = stats.sec_audio = stats.sec_padding = 0;
+   stats.sec_empty = stats.sec_iso = 0;
+
+   for(rec=0;rec<maxrec;rec++)
+   {
+      switch(sec_class[rec])
+      {
+         case SEC_ISO:     stats.sec_iso++;     break;
+         case SEC_VIDEO:   stats.sec_video++;   break;
+         case SEC_AUDIO:   stats.sec_audio++;   break;
+         case SEC_PADDING: stats.sec_padding++; break;
+         default:          stats.sec_empty++;
+      }
+   }
+   stats.bytes_written = (double)maxrec*2352;
 }
 
 static void output_zero(int rec)
 {
    /* Output a zero record */
 
-   do_encode_L2(outrec, MODE_0, rec+150);
-   write_record(rec);
+   start_record(rec);
+   encode_record(MODE_0, rec);
+   write_record(rec, SEC_EMPTY);
 }
 
-void output_form1(int rec, unsigned char *data)
+void output_form1(int rec, char *data)
 {
    int i;
 
@@ -76,6 +302,8 @@ void output_form1(int rec, unsigned char *data)
       maxrec = rec+1;
    }
 
+   start_record(rec);
+
    /* We use the same subheader for all form 1 sectors,
       I dont know if this is completly correct */
 
@@ -90,11 +318,11 @@ void output_form1(int rec, unsigned char *data)
 
    /* Adding of sync, header, ECC, EDC fields */
 
-   do_encode_L2(outrec, MODE_2_FORM_1, rec+150);
+   encode_record(MODE_2_FORM_1, rec);
 
    /* Output record */
 
-   write_record(rec);
+   write_record(rec, SEC_ISO);
 }
 
 void output_form2(int rec, int h1, int h2, int h3, int h4, unsigned char *data)
@@ -110,6 +338,8 @@ void output_form2(int rec, int h1, int h2, int h3, int h4, unsigned char *data)
       maxrec = rec+1;
    }
 
+   start_record(rec);
+
    /* Subheader */
 
    outrec[16] = outrec[20] = h1;
@@ -123,17 +353,38 @@ void output_form2(int rec, int h1, int h2, int h3, int h4, unsigned char *data)
 
    /* Adding of sync, header, EDC */
 
-   do_encode_L2(outrec, MODE_2_FORM_2, rec+150);
+   encode_record(MODE_2_FORM_2, rec);
 
    /* Output record */
 
-   write_record(rec);
+   write_record(rec, form2_class(h2, h3));
+}
+
+static void output_raw(int rec, unsigned char *sec)
+{
+   int i;
+
+   /* Output a record encoded before */
+
+   if(rec+1>maxrec)
+   {
+      for(i=maxrec;i<rec;i++) output_zero(i);
+      maxrec = rec+1;
+   }
+
+   start_record(rec);
+   memcpy(outrec,sec,2352);
+   write_record(rec, form2_class(sec[17], sec[18]));
 }
 
 #define EOF_INDICATOR 0xffffffff
 
 static unsigned long tag;
 
+/* Set by read_mpeg_sec() if it had to stop before the end of the file */
+
+static int mpeg_error;
+
 static int read_tag(FILE *mpeg_file)
 {
    int i, c;
@@ -236,6 +487,7 @@ static int read_mpeg_sec(FILE *mpeg_file, unsigned char *mpeg)
    if(fread(mpeg+4,1,8,mpeg_file)!=8)
    {
       fprintf(stderr,"... Unexpected EOF in MPEG file\n");
+      mpeg_error = 1;
       tag = EOF_INDICATOR;
       return retval;
    }
@@ -257,6 +509,7 @@ static int read_mpeg_sec(FILE *mpeg_file, unsigned char *mpeg)
          /* Illegal tag */
          fprintf(stderr,"... file contains illegal MPEG tag 0x%x\n",tag);
          fprintf(stderr,"... terminating with this file!!!\n");
+         mpeg_error = 1;
          tag = EOF_INDICATOR;
          return retval;
       }
@@ -283,6 +536,7 @@ static int read_mpeg_sec(FILE *mpeg_file, unsigned char *mpeg)
       if(c==EOF)
       {
          fprintf(stderr,"... Unexpected EOF in MPEG file\n");
+         mpeg_error = 1;
          tag = EOF_INDICATOR;
          return retval;
       }
@@ -293,6 +547,7 @@ static int read_mpeg_sec(FILE *mpeg_file, unsigned char *mpeg)
       {
          fprintf(stderr,"... Record in MPEG file too long for VCD\n");
          fprintf(stderr,"... terminating with this file!!!\n");
+         mpeg_error = 1;
          tag = EOF_INDICATOR;
          return retval;
       }
@@ -308,6 +563,7 @@ static int read_mpeg_sec(FILE *mpeg_file, unsigned char *mpeg)
       if(fread(mpeg+n,1,len,mpeg_file)!=len)
       {
          fprintf(stderr,"... Unexpected EOF in MPEG file\n");
+         mpeg_error = 1;
          tag = EOF_INDICATOR;
          return retval;
       }
@@ -326,177 +582,2024 @@ static int read_mpeg_sec(FILE *mpeg_file, unsigned char *mpeg)
    }
 }
 
-#define MAX_MPEG_FILES 32
+/*
+   scan_video:
 
-static unsigned char data[2324];
+   Look for a sequence header or GOP header and for the picture header
+   of an I frame in the video packets of a sector read by
+   read_mpeg_sec(). *pts is set to the last PTS found in the video
+   packets of the sector, if any.
 
-main(int argc, char **argv)
+   returns SCAN_GOP and/or SCAN_IFRAME if such a header starts
+   in this sector
+*/
+
+#define SCAN_GOP    1
+#define SCAN_IFRAME 2
+
+static int scan_video(unsigned char *mpeg, unsigned long *pts)
 {
-   int num_MPEG_files;
-   int MPEG_size   [MAX_MPEG_FILES]; /* in blocks */
-   int MPEG_extent [MAX_MPEG_FILES];
-   FILE *MPEG_file;
-   FILE *fd_toc;
-   int n, extent, m, s, f, i, n1, n2, id;
+   unsigned char *p;
+   int n, k, len, found;
 
-   if(argc<2)
+   found = 0;
+
+   for(n=12; n+6<=2324; n+=6+len)
    {
-      fprintf(stderr,"Usage: %s MPEG-files ....\n",argv[0]);
-      exit(1);
+      p = mpeg+n;
+      if(p[0]!=0 || p[1]!=0 || p[2]!=1 || p[3]<0xbb) break;
+
+      len = (p[4]<<8) | p[5];
+      if(p[3]<0xe0 || p[3]>0xef || n+6+len>2324) continue;
+
+      /* Skip the packet header, get the PTS */
+
+      p += 6;
+      for(k=0; k<len && p[k]==0xff; k++);
+      if(k<len && (p[k]&0xc0)==0x40) k += 2;
+      if(k+5<=len && (p[k]&0xe0)==0x20)
+      {
+         *pts = ((unsigned long)(p[k]&0x0e)<<29) | (p[k+1]<<22) |
+                ((p[k+2]&0xfe)<<14) | (p[k+3]<<7) | (p[k+4]>>1);
+         k += (p[k]&0x10) ? 10 : 5;
+      }
+      else if(k<len && p[k]==0x0f)
+         k++;
+
+      for(; k+4<=len; k++)
+      {
+         if(p[k]!=0 || p[k+1]!=0 || p[k+2]!=1) continue;
+
+         if(p[k+3]==0xb3 || p[k+3]==0xb8)
+            found |= SCAN_GOP;
+
+         /* picture_coding_type follows the 10 bit temporal reference */
+
+         if(p[k+3]==0 && k+6<=len && ((p[k+5]>>3)&7)==1)
+            found |= SCAN_IFRAME;
+      }
    }
 
-   if(argc>MAX_MPEG_FILES+1)
+   return found;
+}
+
+/* A CD has at most 99 tracks, the first one is the ISO file system */
+
+#define MAX_MPEG_FILES 98
+
+/* Everything needed for mastering one disc */
+
+struct vcd_disc {
+   char *image;      /* Binary output file containing the VCD image */
+   char *toc;        /* Table of contents for cdrdao */
+   char *volume_id;  /* ISO 9660 volume id */
+   int  num_MPEG_files;
+   char *MPEG_name[MAX_MPEG_FILES];
+   char *audio_name[MAX_MPEG_FILES];  /* --mux: audio stream, MPEG_name is the video */
+   int  num_files;   /* Files and directories added to the ISO track */
+   char **file;
+};
+
+static struct vcd_disc *cur_disc;
+static FILE *fd_toc;
+
+/* Time stamp for the file system, if set (--source-date-epoch or
+   SOURCE_DATE_EPOCH) identical input gives identical output */
+
+static time_t source_date_epoch = -1;
+
+/* Interval in seconds for additional entry points at GOP starts
+   (-e secs), with 0 there is only one entry point per track */
+
+static int entry_interval = 0;
+
+/* -s: write EXT/SCANDATA.DAT with the sectors of the I frames */
+
+static int scan_data = 0;
+
+/* The players expect a scan point every 0.5 seconds, more I frames
+   than 2 per second of MPEG data (+1 per track) are thinned out
+   (see thin_scan_points()) */
+
+#define SCAN_POINTS_PER_SEC 2
+#define MAX_SCAN_POINTS 65535
+
+/* Tracks of unknown size (pipes) get the room of a full disc */
+
+#define FULL_DISC_MINUTES 80
+
+static int *scan_point;
+static double *scan_time;    /* seconds from the first I frame of the disc */
+static int num_scan_points, max_scan_points;
+
+static void add_scan_point(int rec, double time)
+{
+   if(num_scan_points>=max_scan_points)
    {
-      fprintf(stderr,"Maximum of %d MPEG files exceeded!\n",MAX_MPEG_FILES);
-      exit(1);
+      max_scan_points = max_scan_points ? 2*max_scan_points : 4096;
+      scan_point = (int *) realloc(scan_point, max_scan_points*sizeof(int));
+      scan_time = (double *) realloc(scan_time, max_scan_points*sizeof(double));
+      if(scan_point==0 || scan_time==0)
+      {
+         fprintf(stderr,"Out of memory\n");
+         exit(1);
+      }
    }
+   scan_point[num_scan_points] = rec;
+   scan_time[num_scan_points++] = time;
+}
 
-   num_MPEG_files = argc-1;
+static double time_dist(double a, double b)
+{
+   return (a>b) ? a-b : b-a;
+}
 
-   /* Open binary output file */
+static void thin_scan_points(int max)
+{
+   /* Keep the I frame nearest to every 0.5 seconds of the disc,
+      the times never go back. If these are still too many
+      (the capacity is estimated from the sizes), evenly spaced
+      ones of them are kept */
 
-   xa_fd = open(BINARY_OUTPUT_FILE, O_WRONLY|O_CREAT|O_TRUNC, 0644);
-   if(xa_fd<0)
+   double target;
+   int i, n;
+
+   n = 0;
+   i = 0;
+   for(target=scan_time[0]; i<num_scan_points; target+=1./SCAN_POINTS_PER_SEC)
    {
-      fprintf(stderr,"Can not open %s\n",BINARY_OUTPUT_FILE);
-      perror("open");
-      exit(1);
+      while(i+1<num_scan_points &&
+            time_dist(scan_time[i+1],target)<=time_dist(scan_time[i],target)) i++;
+
+      if(n>0 && scan_point[n-1]==scan_point[i])
+      {
+         /* Nearest to the time before as well */
+
+         if(scan_time[i]<target) i++;
+         continue;
+      }
+
+      scan_point[n] = scan_point[i];
+      scan_time[n++] = scan_time[i];
+      if(scan_time[i]<target) i++;
+   }
+   num_scan_points = n;
+
+   if(num_scan_points>max)
+   {
+      for(i=0;i<max;i++)
+         scan_point[i] = scan_point[(long)i*num_scan_points/max];
+      num_scan_points = max;
    }
+}
+
+static int scan_capacity(long bytes, int ntracks)
+{
+   /* Room for the scan points of bytes of MPEG data in ntracks tracks */
 
-   /* open VCD_TOC_FILE */
+   long cap;
 
-   fd_toc = fopen(VCD_TOC_FILE,"w");
-   if(fd_toc==0)
+   cap = bytes/2324/75*SCAN_POINTS_PER_SEC + ntracks;
+   return (cap>MAX_SCAN_POINTS) ? MAX_SCAN_POINTS : cap;
+}
+
+static unsigned char data[2324];
+
+static void fatal_exit()
+{
+   /* Remove the incomplete output of the current disc */
+
+   fprintf(stderr,"Fatal Error --- exiting\n");
+   close(xa_fd);
+   remove(cur_disc->image);
+   fclose(fd_toc);
+   remove(cur_disc->toc);
+   exit(1);
+}
+
+static char *json_string(char *str)
+{
+   /* Quote str for JSON, the result is valid until the next call */
+
+   static char buf[2048];
+   int n = 0;
+
+   buf[n++] = '"';
+   for(; *str && n<sizeof(buf)-8; str++)
    {
-      fprintf(stderr,"Can not open VCD toc file %s\n",VCD_TOC_FILE);
-      perror("fopen");
-      exit(1);
+      if(*str=='"' || *str=='\\')
+         buf[n++] = '\\';
+      if((unsigned char)*str<0x20)
+      {
+         sprintf(buf+n,"\\u%4.4x",*str);
+         n += 6;
+         continue;
+      }
+      buf[n++] = *str;
    }
+   buf[n++] = '"';
+   buf[n] = 0;
 
-   /* Write the toc file */
+   return buf;
+}
 
-   fprintf(fd_toc,"CD_ROM_XA\n\n");
-   fprintf(fd_toc,"// Track 1: Header with ISO 9660 file system\n");
-   fprintf(fd_toc,"TRACK MODE2_RAW\n");
-   f = ISO_FS_BLOCKS + 150;
-   s = f/75;
-   f = f%75;
-   m = s/60;
-   s = s%60;
-   fprintf(fd_toc,"DATAFILE \"%s\" %2.2d:%2.2d:%2.2d\n\n",BINARY_OUTPUT_FILE,m,s,f);
+/*
+   write_stats:
+
+   Append the statistics of a disc as one line of JSON to stats_file.
+   The whole line is written with one write() call, so the reports
+   of several discs mastered in parallel do not get mixed up.
 
-   extent = ISO_FS_BLOCKS;
+   Times are in seconds: "iso" is the total time for the ISO track,
+   it includes the encoding and writing of its sectors.
+*/
 
-   for(n=0;n<num_MPEG_files;n++)
+static void write_stats(struct vcd_disc *disc)
+{
+   char buf[4096];
+   int fd, n;
+   double t;
+
+   count_records();
+   t = (stats.t_total>0) ? stats.t_total : 1;
+
+   n = sprintf(buf,"{\"image\": %s, ",json_string(disc->image));
+   n += sprintf(buf+n,"\"tracks\": %d, ",disc->num_MPEG_files);
+   n += sprintf(buf+n,"\"sectors\": {\"total\": %d, \"video\": %ld, "
+                      "\"audio\": %ld, \"padding\": %ld, \"empty\": %ld, "
+                      "\"iso\": %ld}, ",
+                maxrec,stats.sec_video,stats.sec_audio,stats.sec_padding,
+                stats.sec_empty,stats.sec_iso);
+   n += sprintf(buf+n,"\"bytes\": {\"read\": %.0f, \"written\": %.0f}, ",
+                stats.bytes_read,stats.bytes_written);
+   n += sprintf(buf+n,"\"seconds\": {\"parse\": %.6f, \"encode\": %.6f, "
+                      "\"write\": %.6f, \"iso\": %.6f, \"total\": %.6f}, ",
+                stats.t_parse,stats.t_encode,stats.t_write,stats.t_iso,
+                stats.t_total);
+   n += sprintf(buf+n,"\"mb_per_second\": {\"read\": %.3f, \"written\": %.3f}}\n",
+                stats.bytes_read/t/1.0e6,stats.bytes_written/t/1.0e6);
+
+   if(strcmp(stats_file,"-")==0)
+      fd = 1;
+   else
+      fd = open(stats_file, O_WRONLY|O_CREAT|O_APPEND, 0644);
+
+   if(fd<0 || write(fd,buf,n)!=n)
    {
-      printf("Copying file %s\n",argv[n+1]);
+      fprintf(stderr,"Can not write statistics to %s\n",stats_file);
+      perror("write");
+   }
 
-      MPEG_file = fopen(argv[n+1],"rb");
-      if(MPEG_file==0)
+   if(fd>1) close(fd);
+}
+
+/*
+   A track as written to an image: the sectors with GOP starts and
+   I frames are kept for the entry and scan points.
+
+   With --variants the tracks are kept for all discs of the job file,
+   a track already written to the image of an earlier disc is copied
+   from there (see copy_track) instead of being parsed and encoded again.
+*/
+
+struct gop {
+   int offset;          /* sector, counted from the end of the pre gap */
+   unsigned long pts;
+};
+
+struct track_info {
+   char *name;          /* MPEG file (with --mux the video stream) */
+   char *audio;         /* with --mux the audio stream, 0 otherwise */
+   char *image;         /* image holding the encoded track, 0 if none yet */
+   int  start;          /* first sector (of the pre gap) in image */
+   int  file_number;    /* file number of the subheaders in image */
+   int  nsecs;          /* sectors including pre gap and end gap */
+   int  size;           /* size of the AVSEQ file in blocks */
+   long bytes_read;
+   int  num_gops, num_iframes;
+   struct gop *gop;
+   struct gop *iframe;  /* I frames, like gop[] */
+};
+
+static int variants = 0;
+static struct track_info *track_info;
+static int num_track_info;
+
+static void *grow(void *ptr, int num, int size)
+{
+   /* Make room for element num of a growable array */
+
+   if((num & (num-1))==0)
+   {
+      ptr = realloc(ptr, (num ? 2*num : 64)*size);
+      if(ptr==0)
       {
-         fprintf(stderr,"Can not open file %s\n",argv[n+1]);
-         perror("open");
-         fprintf(stderr,"Fatal Error --- exiting\n");
-         close(xa_fd);
-         remove(BINARY_OUTPUT_FILE);
-         fclose(fd_toc);
-         remove(VCD_TOC_FILE);
+         fprintf(stderr,"Out of memory\n");
          exit(1);
       }
+   }
+   return ptr;
+}
 
-      /* Pre gap  */
+static struct track_info *get_track_info(char *name)
+{
+   struct track_info *ti;
+   int n;
 
-      memset(data,0,2324);
-      for(i=0;i<150;i++) output_form2(extent++,0,0,0x20,0,data);
+   if(variants)
+   {
+      for(n=0;n<num_track_info;n++)
+         if(strcmp(track_info[n].name,name)==0) return track_info+n;
+   }
+   else
+   {
+      /* Nothing is kept */
 
-      MPEG_extent[n] = extent;
+      for(n=0;n<num_track_info;n++)
+      {
+         free(track_info[n].gop);
+         free(track_info[n].iframe);
+      }
+      num_track_info = 0;
+   }
 
-      /* 30 empty form 2 blocks at the beginning */
+   track_info = (struct track_info *) grow(track_info, num_track_info,
+                                            sizeof(struct track_info));
+   ti = track_info + num_track_info++;
+   memset(ti,0,sizeof(struct track_info));
+   ti->name = name;
 
-      memset(data,0,2324);
-      for(i=0;i<30;i++) output_form2(extent++,n+1,0,0x60,0,data);
+   return ti;
+}
 
-      /* Output the file itself */
+/*
+   encode_pack:
 
-      tag = 0; /* new file starts */
+   Write one pack of MPEG data (2324 bytes) as sector of the track
+   being encoded, id is the stream id as returned by read_mpeg_sec(),
+   last is set for the last pack of the track.
+   This is the pack sink of the multiplexer with --mux (see mplex.h).
+*/
 
-      for(i=0;;i++)
-      {
-         id=read_mpeg_sec(MPEG_file,data);
+static struct track_info *enc_ti;
+static int *enc_extent, enc_file_number, enc_secs;
+static unsigned long enc_pts;
 
-         if(tag==EOF_INDICATOR && i<150)
-         {
-            fprintf(stderr,"Not enough MPEG data\n");
-            id = -1;
-         }
+static void encode_pack(unsigned char *pack, int id, int last)
+{
+   struct track_info *ti = enc_ti;
+   int n1, n2, found, offset;
 
-         if(id<0)
-         {
-            fprintf(stderr,"Fatal Error --- exiting\n");
-            close(xa_fd);
-            remove(BINARY_OUTPUT_FILE);
-            fclose(fd_toc);
-            remove(VCD_TOC_FILE);
-            exit(1);
-         }
+   if(last && enc_secs<150)
+   {
+      fprintf(stderr,"Not enough MPEG data\n");
+      fatal_exit();
+   }
 
-         /* Subheader stuff, I don't know exactly for what some flags are */
+   /* Remember GOP starts and I frames */
 
-         n1 = 0x60;
-         n2 = 0;
+   found = 0;
+   if(entry_interval>0 || scan_data) found = scan_video(pack,&enc_pts);
 
-         if(id == 0xe0)
-         {
-            /* Video data */
-            n1 = 0x62;
-            n2 = 0x0f;
-         }
-         else if(id == 0xc0)
-         {
-            /* Audio data */
-            n1 = 0x64;
-            n2 = 0x7f;
-         }
+   offset = *enc_extent - ti->start - 150;
 
-         if(tag==EOF_INDICATOR) n1 |= 1;
+   if(found & SCAN_IFRAME)
+   {
+      ti->iframe = (struct gop *) grow(ti->iframe, ti->num_iframes, sizeof(struct gop));
+      ti->iframe[ti->num_iframes].offset = offset;
+      ti->iframe[ti->num_iframes].pts = enc_pts;
+      ti->num_iframes++;
+   }
+   if(found & SCAN_GOP)
+   {
+      ti->gop = (struct gop *) grow(ti->gop, ti->num_gops, sizeof(struct gop));
+      ti->gop[ti->num_gops].offset = offset;
+      ti->gop[ti->num_gops].pts = enc_pts;
+      ti->num_gops++;
+   }
 
-         output_form2(extent++,n+1,1,n1,n2,data);
+   /* Subheader stuff, I don't know exactly for what some flags are */
 
-         if(tag==EOF_INDICATOR)
-         {
-            fprintf(stderr,"Done with %s, got %d sectors\n",argv[n+1],i+1);
-            break;
-         }
-      }
+   n1 = 0x60;
+   n2 = 0;
 
-      MPEG_size[n] = i+75;
+   if(id == 0xe0)
+   {
+      /* Video data */
+      n1 = 0x62;
+      n2 = 0x0f;
+   }
+   else if(id == 0xc0)
+   {
+      /* Audio data */
+      n1 = 0x64;
+      n2 = 0x7f;
+   }
 
-      /* 45 empty form 2 blocks at the end */
+   if(last) n1 |= 1;
 
-      memset(data,0,2324);
-      for(i=0;i<40;i++) output_form2(extent++,n+1,0,0x60,0,data);
-      output_form2(extent++,n+1,0,0xe1,0,data);
-      for(i=0;i<4;i++) output_form2(extent++,0,0,0x20,0,data);
+   output_form2((*enc_extent)++,enc_file_number,1,n1,n2,pack);
+   enc_secs++;
 
-      /* Update TOC file */
+   if(last) fprintf(stderr,"Done with %s, got %d sectors\n",ti->name,enc_secs);
+}
 
-      fprintf(fd_toc,"// Track %d: MPEG data from %s\n",n+2,argv[n+1]);
-      fprintf(fd_toc,"TRACK MODE2_RAW\n");
-      f = MPEG_size[n];
-      if(n!=num_MPEG_files-1) f += 150;
-      s = f/75;
-      f = f%75;
-      m = s/60;
-      s = s%60;
-      fprintf(fd_toc,"DATAFILE \"%s\" #%d %2.2d:%2.2d:%2.2d\n\n",
-                     BINARY_OUTPUT_FILE,MPEG_extent[n]*2352,m,s,f);
+/*
+   encode_track:
 
-      /* Finally close MPEG file */
+   Parse the MPEG file of ti (or multiplex its video and audio streams
+   with --mux) and write it as track with file number file_number
+   starting at sector *extent (with the pre gap).
+*/
 
-      fclose(MPEG_file);
-   }
+static void encode_track(struct track_info *ti, int *extent, int file_number)
+{
+   FILE *MPEG_file;
+   int i, id;
+   double t0 = 0, t_out = 0;
 
-   /* Finally make the first Track with the ISO file system */
+   MPEG_file = 0;
+   if(ti->audio==0)
+   {
+      MPEG_file = fopen(ti->name,"rb");
+      if(MPEG_file==0)
+      {
+         fprintf(stderr,"Can not open file %s\n",ti->name);
+         perror("open");
+         fatal_exit();
+      }
+   }
+
+   ti->start = *extent;
+   ti->file_number = file_number;
+   ti->num_gops = ti->num_iframes = 0;
+
+   /* Pre gap  */
+
+   memset(data,0,2324);
+   for(i=0;i<150;i++) output_form2((*extent)++,0,0,0x20,0,data);
+
+   /* 30 empty form 2 blocks at the beginning */
+
+   memset(data,0,2324);
+   for(i=0;i<30;i++) output_form2((*extent)++,file_number,0,0x60,0,data);
+
+   /* Output the file itself */
+
+   enc_ti = ti;
+   enc_extent = extent;
+   enc_file_number = file_number;
+   enc_secs = 0;
+   enc_pts = 0;
+
+   if(ti->audio)
+   {
+      /* The packs come from the multiplexer, the time for encoding
+         and writing them is not counted as parsing */
+
+      if(stats_file)
+      {
+         t0 = now();
+         t_out = stats.t_encode + stats.t_write;
+      }
+      mplex(ti->name, ti->audio, -1, encode_pack);
+      if(stats_file) stats.t_parse += now()-t0 - (stats.t_encode+stats.t_write-t_out);
+   }
+   else
+   {
+      tag = 0; /* new file starts */
+
+      do
+      {
+         if(stats_file) t0 = now();
+         id=read_mpeg_sec(MPEG_file,data);
+         if(stats_file) stats.t_parse += now()-t0;
+
+         if(id<0) fatal_exit();
+
+         encode_pack(data, id, tag==EOF_INDICATOR);
+      }
+      while(tag!=EOF_INDICATOR);
+   }
+
+   ti->size = enc_secs+74;
+
+   /* 45 empty form 2 blocks at the end */
+
+   memset(data,0,2324);
+   for(i=0;i<40;i++) output_form2((*extent)++,file_number,0,0x60,0,data);
+   output_form2((*extent)++,file_number,0,0xe1,0,data);
+   for(i=0;i<4;i++) output_form2((*extent)++,0,0,0x20,0,data);
+
+   ti->nsecs = *extent - ti->start;
+
+   /* Finally close MPEG file */
+
+   if(MPEG_file)
+   {
+      ti->bytes_read = ftell(MPEG_file);
+      fclose(MPEG_file);
+   }
+   else
+      ti->bytes_read = (long)enc_secs*2324;
+}
+
+/*
+   copy_track:
+
+   Copy a track encoded before from its image to sector *extent.
+   Form 2 sectors are relocated by a new address in the header (which is
+   not covered by the EDC) and, if the track has another number on this
+   disc, a new file number in the subheader. The EDC is linear, so it
+   is corrected by the EDC of the change of the file number.
+*/
+
+#define COPY_SECS 64
+
+static void copy_track(struct track_info *ti, int *extent, int file_number)
+{
+   static unsigned int file_edc[256];
+   static unsigned char buf[COPY_SECS*2352];
+   unsigned char *sec, delta[2352];
+   unsigned int edc;
+   int fd, n, k, num, rec, d;
+   double t0 = 0;
+
+   if(file_edc[1]==0)
+   {
+      /* EDC of a change of both file number bytes of the subheader */
+
+      memset(delta,0,2352);
+      for(d=1;d<256;d++)
+      {
+         delta[16] = delta[20] = d;
+         file_edc[d] = build_edc(delta,16,2347);
+      }
+   }
+
+   fd = open(ti->image, O_RDONLY);
+   if(fd<0)
+   {
+      fprintf(stderr,"Can not open %s\n",ti->image);
+      perror("open");
+      fatal_exit();
+   }
+
+   for(n=0; n<ti->nsecs; n+=num)
+   {
+      num = (ti->nsecs-n<COPY_SECS) ? ti->nsecs-n : COPY_SECS;
+
+      if(stats_file) t0 = now();
+      if(lseek(fd,(off_t)(ti->start+n)*2352,SEEK_SET)<0 ||
+         read(fd,buf,num*2352)!=num*2352)
+      {
+         fprintf(stderr,"Error reading %s from %s\n",ti->name,ti->image);
+         fatal_exit();
+      }
+      if(stats_file) stats.t_parse += now()-t0;
+
+      for(k=0;k<num;k++)
+      {
+         sec = buf + k*2352;
+         rec = (*extent)++;
+
+         if(sec[16]!=0 && sec[16]!=file_number)
+         {
+            edc = file_edc[sec[16]^file_number];
+            sec[16] = sec[20] = file_number;
+            sec[2348] ^= edc;
+            sec[2349] ^= edc>>8;
+            sec[2350] ^= edc>>16;
+            sec[2351] ^= edc>>24;
+         }
+
+         sec[12] = BCD((rec+150)/4500);
+         sec[13] = BCD(((rec+150)/75)%60);
+         sec[14] = BCD((rec+150)%75);
+
+         output_raw(rec, sec);
+      }
+   }
+
+   close(fd);
+}
+
+/*
+   The toc file for cdrdao: the ISO track and one entry per MPEG track
+   at its byte offset in the image. The length of a track includes the
+   pre gap of the next one.
+*/
+
+static void write_toc_header(FILE *fd, char *image, int iso_blocks)
+{
+   int m, s, f;
+
+   fprintf(fd,"CD_ROM_XA\n\n");
+   fprintf(fd,"// Track 1: Header with ISO 9660 file system\n");
+   fprintf(fd,"TRACK MODE2_RAW\n");
+   f = iso_blocks + 150;
+   s = f/75;
+   f = f%75;
+   m = s/60;
+   s = s%60;
+   fprintf(fd,"DATAFILE \"%s\" %2.2d:%2.2d:%2.2d\n\n",image,m,s,f);
+}
+
+static void write_toc_track(FILE *fd, int n, char *MPEG_name, char *image,
+                            int MPEG_extent, int MPEG_size, int last)
+{
+   int m, s, f;
+
+   fprintf(fd,"// Track %d: MPEG data from %s\n",n+2,MPEG_name);
+   fprintf(fd,"TRACK MODE2_RAW\n");
+   f = MPEG_size;
+   if(!last) f += 150;
+   s = f/75;
+   f = f%75;
+   m = s/60;
+   s = s%60;
+   fprintf(fd,"DATAFILE \"%s\" #%d %2.2d:%2.2d:%2.2d\n\n",
+               image,MPEG_extent*2352,m,s,f);
+}
+
+static long file_bytes(char *name)
+{
+   /* Size of a file, -1 for pipes, FIFOs and stdin */
+
+   struct stat st;
+
+   if(strcmp(name,"-")==0 || stat(name,&st)<0 || !S_ISREG(st.st_mode))
+      return -1;
+   return st.st_size;
+}
+
+static long track_bytes(struct vcd_disc *disc, int n)
+{
+   /* Size of the MPEG data of track n, with --mux estimated from the
+      sizes of the elementary streams and 2279 bytes of audio in a
+      pack of 2324 bytes. -1 if not known */
+
+   long bytes, audio;
+
+   bytes = file_bytes(disc->MPEG_name[n]);
+
+   if(disc->audio_name[n] && bytes>=0)
+   {
+      audio = file_bytes(disc->audio_name[n]);
+      bytes = (audio<0) ? -1 : (double)(bytes+audio)*2324/2279;
+   }
+
+   return bytes;
+}
+
+static int disc_scan_points(struct vcd_disc *disc)
+{
+   /* Room for scan points on the disc, 0 without -s */
+
+   long bytes, b;
+   int n;
+
+   if(!scan_data) return 0;
+
+   bytes = 0;
+   for(n=0;n<disc->num_MPEG_files;n++)
+   {
+      b = track_bytes(disc,n);
+      if(b<0)
+      {
+         fprintf(stderr,"Warning: size of %s not known, room for the scan "
+                        "points of %d minutes reserved\n",
+                 disc->MPEG_name[n],FULL_DISC_MINUTES);
+         bytes = (long)FULL_DISC_MINUTES*60*75*2324;
+         break;
+      }
+      bytes += b;
+   }
+
+   return scan_capacity(bytes, disc->num_MPEG_files);
+}
+
+/*
+   master_disc:
+
+   Write the image and the toc file of a disc.
+   Exits on fatal errors after removing the output files.
+*/
+
+static void master_disc(struct vcd_disc *disc)
+{
+   int MPEG_size   [MAX_MPEG_FILES]; /* in blocks */
+   int MPEG_extent [MAX_MPEG_FILES];
+   long MPEG_bytes [MAX_MPEG_FILES];
+   struct track_info *ti[MAX_MPEG_FILES];
+   struct vcd_entry entry[MAX_ENTRIES];
+   int n, extent, i, k, iso_blocks;
+   int num_entries, budget, track_entries, max_track_entries;
+   int scan_points;
+   long bytes_left;
+   unsigned long last_pts;
+   long long dpts;
+   double t0 = 0, t_start = 0, scan_clock;
+
+   cur_disc = disc;
+   maxrec = 0;
+   memset(&stats,0,sizeof(stats));
+   if(sec_class) memset(sec_class,0,max_sec_class);
+   if(stats_file) t_start = now();
+
+   /* Open binary output file */
+
+   xa_fd = open(disc->image, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+   if(xa_fd<0)
+   {
+      fprintf(stderr,"Can not open %s\n",disc->image);
+      perror("open");
+      exit(1);
+   }
+
+   /* open toc file */
+
+   fd_toc = fopen(disc->toc,"w");
+   if(fd_toc==0)
+   {
+      fprintf(stderr,"Can not open VCD toc file %s\n",disc->toc);
+      perror("fopen");
+      close(xa_fd);
+      remove(disc->image);
+      exit(1);
+   }
+
+   /* The size of the first track depends on the file system,
+      with -s on the room needed for the scan points */
+
+   scan_points = disc_scan_points(disc);
+   num_scan_points = 0;
+   scan_clock = 0;
+
+   iso_blocks = vcd_iso_layout(disc->num_MPEG_files, scan_points,
+                               disc->num_files, disc->file);
+
+   /* Write the toc file */
+
+   write_toc_header(fd_toc, disc->image, iso_blocks);
+
+   extent = iso_blocks;
+
+   /* Every track gets an entry point at its start, the entries
+      left are shared by the tracks according to their size,
+      evenly if a size is not known */
+
+   num_entries = 0;
+   budget = MAX_ENTRIES - disc->num_MPEG_files;
+   bytes_left = 0;
+
+   if(entry_interval>0)
+   {
+      for(n=0;n<disc->num_MPEG_files;n++)
+      {
+         MPEG_bytes[n] = track_bytes(disc,n);
+         if(MPEG_bytes[n]<0)
+         {
+            fprintf(stderr,"Warning: size of %s not known, the entry points "
+                           "are shared evenly by the tracks\n",
+                    disc->MPEG_name[n]);
+            bytes_left = -1;
+            break;
+         }
+         bytes_left += MPEG_bytes[n];
+      }
+   }
+
+   for(n=0;n<disc->num_MPEG_files;n++)
+   {
+      ti[n] = get_track_info(disc->MPEG_name[n]);
+      ti[n]->audio = disc->audio_name[n];
+
+      if(ti[n]->image)
+      {
+         printf("Copying file %s from %s\n",disc->MPEG_name[n],ti[n]->image);
+         copy_track(ti[n], &extent, n+1);
+      }
+      else
+      {
+         if(ti[n]->audio)
+            printf("Multiplexing files %s and %s\n",disc->MPEG_name[n],ti[n]->audio);
+         else
+            printf("Copying file %s\n",disc->MPEG_name[n]);
+         encode_track(ti[n], &extent, n+1);
+         if(stats_file) stats.bytes_read += ti[n]->bytes_read;
+      }
+
+      MPEG_extent[n] = extent - ti[n]->nsecs + 150;
+      MPEG_size[n] = ti[n]->size;
+
+      entry[num_entries].track  = n+2;
+      entry[num_entries].extent = MPEG_extent[n];
+      num_entries++;
+
+      /* Additional entry points at the sectors starting a GOP,
+         the first GOP is at the start of the track */
+
+      max_track_entries = 0;
+      if(entry_interval>0 && bytes_left<0)
+         max_track_entries = budget/(disc->num_MPEG_files-n);
+      else if(entry_interval>0 && bytes_left>0)
+         max_track_entries = (double)budget*MPEG_bytes[n]/bytes_left;
+      track_entries = 0;
+
+      for(k=1;k<ti[n]->num_gops && entry_interval>0;k++)
+      {
+         if(k==1) last_pts = ti[n]->gop[0].pts;
+
+         /* The PTS may go back (streams put together, wrap around),
+            the interval is counted from there then */
+
+         dpts = (long long)ti[n]->gop[k].pts - (long long)last_pts;
+         if(dpts<0)
+         {
+            last_pts = ti[n]->gop[k].pts;
+            continue;
+         }
+
+         if(dpts>=entry_interval*90000LL &&
+            track_entries<max_track_entries)
+         {
+            entry[num_entries].track  = n+2;
+            entry[num_entries].extent = MPEG_extent[n] + ti[n]->gop[k].offset;
+            num_entries++;
+            track_entries++;
+            last_pts = ti[n]->gop[k].pts;
+         }
+      }
+
+      if(scan_data)
+      {
+         /* The playing time of the disc is counted from the PTS like
+            the entry intervals above, a new track continues 0.5 s after
+            the last I frame of the one before */
+
+         for(k=0;k<ti[n]->num_iframes;k++)
+         {
+            if(k>0)
+            {
+               dpts = (long long)ti[n]->iframe[k].pts -
+                      (long long)ti[n]->iframe[k-1].pts;
+               if(dpts>0) scan_clock += dpts/90000.;
+            }
+            add_scan_point(MPEG_extent[n] + ti[n]->iframe[k].offset, scan_clock);
+         }
+         scan_clock += 1./SCAN_POINTS_PER_SEC;
+      }
+
+      /* Update TOC file */
+
+      write_toc_track(fd_toc, n, disc->MPEG_name[n], disc->image,
+                      MPEG_extent[n], MPEG_size[n], n==disc->num_MPEG_files-1);
+
+      if(entry_interval>0)
+      {
+         printf("%d entry points for %s\n",track_entries+1,disc->MPEG_name[n]);
+         budget -= track_entries;
+         if(bytes_left>0) bytes_left -= MPEG_bytes[n];
+      }
+   }
+
+   /* Finally make the first Track with the ISO file system */
+
+   if(stats_file) t0 = now();
+   if(scan_data)
+   {
+      if(num_scan_points>scan_points)
+      {
+         k = num_scan_points;
+         thin_scan_points(scan_points);
+         fprintf(stderr,"Warning: %d I frames, only %d scan points kept\n",
+                 k,num_scan_points);
+      }
+      printf("%d scan points\n",num_scan_points);
+      vcd_iso_scandata(num_scan_points, scan_point);
+   }
+   mk_vcd_iso_fs(disc->num_MPEG_files, MPEG_extent, MPEG_size,
+                 num_entries, entry, disc->volume_id,
+                 (source_date_epoch>=0) ? source_date_epoch : time(0));
+   flush_records();
+   if(stats_file) stats.t_iso += now()-t0;
+
+   fclose(fd_toc);
+   close(xa_fd);
+
+   /* Later discs copy the tracks encoded here */
+
+   if(variants)
+      for(n=0;n<disc->num_MPEG_files;n++)
+         if(ti[n]->image==0) ti[n]->image = disc->image;
+
+   if(stats_file)
+   {
+      stats.t_total = now()-t_start;
+      write_stats(disc);
+   }
+}
+
+/* Batch mode: the discs listed in a job file */
+
+static struct vcd_disc *batch_disc;
+static int num_batch_discs;
+
+static void add_file(struct vcd_disc *disc, char *path)
+{
+   disc->file = (char **) realloc(disc->file,(disc->num_files+1)*sizeof(char *));
+   if(disc->file==0)
+   {
+      fprintf(stderr,"Out of memory\n");
+      exit(1);
+   }
+   disc->file[disc->num_files++] = path;
+}
+
+static char *toc_name(char *image)
+{
+   /* The toc file name defaults to the image name with extension .toc */
+
+   char *name, *p;
+
+   name = (char *) malloc(strlen(image)+5);
+   if(name==0)
+   {
+      fprintf(stderr,"Out of memory\n");
+      exit(1);
+   }
+   strcpy(name,image);
+
+   p = strrchr(name,'.');
+   if(p==0 || strchr(p,'/')) p = name+strlen(name);
+   strcpy(p,".toc");
+
+   return name;
+}
+
+/*
+   read_job_file:
+
+   A job file describes the discs to be mastered, for example:
+
+      # comment
+      disc
+      image   movie1.bin
+      toc     movie1.toc
+      volume  MOVIE DISC 1
+      track   part1.mpg
+      track   part2.mpg
+      file    README.TXT
+      file    extras
+
+      disc
+      image   movie2.bin
+      track   part3.mpg
+
+   Every disc starts with the keyword "disc". "file" adds a file
+   or directory to the ISO file system (like -f). If "toc" is missing
+   the image name is used with the extension replaced by .toc,
+   if "volume" is missing CD_VOLUME_ID is used.
+*/
+
+static void read_job_file(char *filename)
+{
+   FILE *fd;
+   char line[1024], *key, *val, *p;
+   struct vcd_disc *disc;
+   int lineno, n;
+
+   fd = fopen(filename,"r");
+   if(fd==0)
+   {
+      fprintf(stderr,"Can not open job file %s\n",filename);
+      perror("fopen");
+      exit(1);
+   }
+
+   disc = 0;
+   lineno = 0;
+
+   while(fgets(line,sizeof(line),fd))
+   {
+      lineno++;
+
+      /* Split line into keyword and value */
+
+      for(key=line; *key==' ' || *key=='\t'; key++);
+      if(*key=='#' || *key=='\n' || *key==0) continue;
+
+      for(p=key+strlen(key); p>key && (p[-1]=='\n' || p[-1]=='\r' ||
+                                       p[-1]==' ' || p[-1]=='\t'); p--);
+      *p = 0;
+
+      for(val=key; *val && *val!=' ' && *val!='\t'; val++);
+      if(*val) *val++ = 0;
+      while(*val==' ' || *val=='\t') val++;
+
+      if(strcmp(key,"disc")==0)
+      {
+         batch_disc = (struct vcd_disc *)
+            realloc(batch_disc,(num_batch_discs+1)*sizeof(struct vcd_disc));
+         if(batch_disc==0)
+         {
+            fprintf(stderr,"Out of memory\n");
+            exit(1);
+         }
+         disc = batch_disc + num_batch_discs++;
+         memset(disc,0,sizeof(struct vcd_disc));
+         disc->volume_id = CD_VOLUME_ID;
+         continue;
+      }
+
+      if(disc==0)
+      {
+         fprintf(stderr,"%s, line %d: \"%s\" before first \"disc\"\n",
+                        filename,lineno,key);
+         exit(1);
+      }
+
+      if(*val==0)
+      {
+         fprintf(stderr,"%s, line %d: missing value for \"%s\"\n",
+                        filename,lineno,key);
+         exit(1);
+      }
+
+      if(strcmp(key,"image")==0)
+         disc->image = strdup(val);
+      else if(strcmp(key,"toc")==0)
+         disc->toc = strdup(val);
+      else if(strcmp(key,"volume")==0)
+         disc->volume_id = strdup(val);
+      else if(strcmp(key,"file")==0)
+         add_file(disc, strdup(val));
+      else if(strcmp(key,"track")==0)
+      {
+         if(disc->num_MPEG_files>=MAX_MPEG_FILES)
+         {
+            fprintf(stderr,"%s, line %d: Maximum of %d MPEG files exceeded!\n",
+                           filename,lineno,MAX_MPEG_FILES);
+            exit(1);
+         }
+         disc->MPEG_name[disc->num_MPEG_files++] = strdup(val);
+      }
+      else
+      {
+         fprintf(stderr,"%s, line %d: unknown keyword \"%s\"\n",
+                        filename,lineno,key);
+         exit(1);
+      }
+   }
+
+   fclose(fd);
+
+   /* Check that all discs are complete */
+
+   for(n=0;n<num_batch_discs;n++)
+   {
+      disc = batch_disc + n;
+      if(disc->image==0 || disc->num_MPEG_files==0)
+      {
+         fprintf(stderr,"%s: disc %d needs an image and at least one track\n",
+                        filename,n+1);
+         exit(1);
+      }
+      if(disc->toc==0) disc->toc = toc_name(disc->image);
+   }
+
+   if(num_batch_discs==0)
+   {
+      fprintf(stderr,"%s: no discs found\n",filename);
+      exit(1);
+   }
+}
+
+static int master_batch_disc(int n)
+{
+   master_disc(batch_disc+n);
+   printf("Disc %d: %s finished\n",n+1,batch_disc[n].image);
+   return 0;
+}
+
+/*
+   count_mpeg_secs:
+
+   Number of MPEG sectors master_disc() will write for a file.
+
+   Files written by vcdmplex have a pack every 2324 bytes and the
+   end code in a sector of its own. Their count follows from the
+   file size, only the last pack has to be looked at: read_mpeg_sec()
+   merges the end code into it if there is room left.
+   All other files are parsed with read_mpeg_sec(), without encoding.
+
+   returns -1 on error
+*/
+
+static int count_mpeg_secs(char *filename)
+{
+   FILE *fd;
+   long size, nblocks;
+   int i, n, len;
+
+   fd = fopen(filename,"rb");
+   if(fd==0)
+   {
+      fprintf(stderr,"Can not open file %s\n",filename);
+      perror("open");
+      return -1;
+   }
+
+   fseek(fd,0,SEEK_END);
+   size = ftell(fd);
+   nblocks = size/2324;
+
+   if(size%2324==0 && nblocks>=2)
+   {
+      /* First and last block must start with pack start and end code */
+
+      fseek(fd,0,SEEK_SET);
+      n = fread(data,1,4,fd);
+      fseek(fd,(nblocks-1)*2324,SEEK_SET);
+      n += fread(data+4,1,4,fd);
+
+      if(n==8 && memcmp(data,"\0\0\1\272\0\0\1\271",8)==0)
+      {
+         /* Find the end of the packets in the last pack */
+
+         fseek(fd,(nblocks-2)*2324,SEEK_SET);
+         if(fread(data,1,2324,fd)==2324 && memcmp(data,"\0\0\1\272",4)==0)
+         {
+            for(n=12; n+6<=2324; n+=6+len)
+            {
+               if(data[n]!=0 || data[n+1]!=0 || data[n+2]!=1 || data[n+3]<0xbb)
+                  break;
+               len = (data[n+4]<<8) | data[n+5];
+            }
+
+            /* Only zeros may follow the packets */
+
+            for(i=n; i<2324 && data[i]==0; i++);
+
+            if(n<=2324 && i==2324)
+            {
+               fclose(fd);
+               return (n+4<=2324) ? nblocks-1 : nblocks;
+            }
+         }
+      }
+   }
+
+   /* Parse the whole file */
+
+   rewind(fd);
+   tag = 0;
+
+   for(i=0;;i++)
+   {
+      if(read_mpeg_sec(fd,data)<0)
+      {
+         fclose(fd);
+         return -1;
+      }
+      if(tag==EOF_INDICATOR) break;
+   }
+
+   fclose(fd);
+   return i+1;
+}
+
+static void print_msf(int secs)
+{
+   printf("%2.2d:%2.2d:%2.2d",secs/4500,(secs/75)%60,secs%75);
+}
+
+/*
+   dry_run_disc (--dry-run):
+
+   Write the toc file of a disc exactly as master_disc() would and
+   print the geometry of the image as one line of JSON, without
+   encoding or writing a single sector. The sizes of the tracks are
+   taken from count_mpeg_secs(), the ISO track from vcd_iso_layout().
+
+   Sectors are counted from the start of the image, "start" is the
+   first sector of a track after its pre gap ("msf" as on the CD,
+   with the 2 seconds in front of track 1), "length" its length in
+   the toc file.
+*/
+
+static void dry_run_disc(struct vcd_disc *disc)
+{
+   int n, secs, extent, size, iso_blocks;
+   double t_start;
+
+   t_start = now();
+
+   iso_blocks = vcd_iso_layout(disc->num_MPEG_files, disc_scan_points(disc),
+                               disc->num_files, disc->file);
+
+   fd_toc = fopen(disc->toc,"w");
+   if(fd_toc==0)
+   {
+      fprintf(stderr,"Can not open VCD toc file %s\n",disc->toc);
+      perror("fopen");
+      exit(1);
+   }
+
+   write_toc_header(fd_toc, disc->image, iso_blocks);
+
+   printf("{\"image\": %s, ",json_string(disc->image));
+   printf("\"toc\": %s, ",json_string(disc->toc));
+   printf("\"iso\": {\"sectors\": %d, \"length\": \"",iso_blocks);
+   print_msf(iso_blocks+150);
+   printf("\"}, \"tracks\": [");
+
+   extent = iso_blocks;
+
+   for(n=0;n<disc->num_MPEG_files;n++)
+   {
+      secs = count_mpeg_secs(disc->MPEG_name[n]);
+      if(secs<0)
+      {
+         fprintf(stderr,"Can not read %s\n",disc->MPEG_name[n]);
+         fclose(fd_toc);
+         remove(disc->toc);
+         exit(1);
+      }
+      if(secs<=150)
+      {
+         fprintf(stderr,"%s: Not enough MPEG data\n",disc->MPEG_name[n]);
+         fclose(fd_toc);
+         remove(disc->toc);
+         exit(1);
+      }
+
+      /* As written by master_disc(): pre gap, 30 empty sectors,
+         the MPEG sectors and 45 sectors at the end */
+
+      extent += 150;
+      size = secs+74;
+
+      write_toc_track(fd_toc, n, disc->MPEG_name[n], disc->image,
+                      extent, size, n==disc->num_MPEG_files-1);
+
+      printf("%s{\"track\": %d, \"file\": %s, \"start\": %d, \"msf\": \"",
+             n ? ", " : "", n+2, json_string(disc->MPEG_name[n]), extent);
+      print_msf(extent+150);
+      printf("\", \"offset\": %ld, \"sectors\": %d, \"length\": \"",
+             (long)extent*2352, size);
+      print_msf((n==disc->num_MPEG_files-1) ? size : size+150);
+      printf("\"}");
+
+      extent += 30+secs+45;
+   }
+
+   if(fclose(fd_toc))
+   {
+      fprintf(stderr,"Can not write VCD toc file %s\n",disc->toc);
+      perror("fclose");
+      exit(1);
+   }
+
+   printf("], \"sectors\": %d, \"bytes\": %.0f, \"seconds\": %.6f}\n",
+          extent,(double)extent*2352,now()-t_start);
+}
+
+/*
+   Split planner (--plan minutes):
+
+   The MPEG files are distributed over the fewest discs of the given
+   capacity. Every track occupies its MPEG sectors plus 225 sectors
+   written by master_disc() (150 pre gap, 30 in front, 45 at the end),
+   every disc the 150 sectors before track 1 plus the ISO track.
+
+   The tracks are packed first fit decreasing, with --keep-order the
+   discs are filled one after the other in the order given.
+   Within a disc the tracks always keep the order of the command line.
+*/
+
+#define TRACK_GAP_SECS (150+30+45)
+
+static int plan_iso_blocks[MAX_MPEG_FILES+1];
+static int plan_scan_points;
+static int *plan_secs;
+
+static int plan_iso_size(struct vcd_disc *disc, int ntracks)
+{
+   /* The ISO track of a disc with ntracks MPEG tracks */
+
+   if(plan_iso_blocks[ntracks]==0)
+      plan_iso_blocks[ntracks] = vcd_iso_layout(ntracks, plan_scan_points,
+                                                disc->num_files, disc->file);
+
+   return plan_iso_blocks[ntracks];
+}
+
+static int cmp_plan_tracks(const void *a, const void *b)
+{
+   /* Bigger tracks first, equal ones in command line order */
+
+   int ta = *(const int *)a, tb = *(const int *)b;
+
+   if(plan_secs[ta]!=plan_secs[tb]) return plan_secs[tb] - plan_secs[ta];
+   return ta - tb;
+}
+
+static char *disc_name(char *name, int number)
+{
+   /* Insert _number before the extension of name */
+
+   char *new, *p;
+   int len;
+
+   new = (char *) malloc(strlen(name)+16);
+   if(new==0)
+   {
+      fprintf(stderr,"Out of memory\n");
+      exit(1);
+   }
+
+   p = strrchr(name,'.');
+   if(p==0 || strchr(p,'/')) p = name+strlen(name);
+   len = p-name;
+
+   sprintf(new,"%.*s_%d%s",len,name,number,p);
+
+   return new;
+}
+
+static void plan_discs(struct vcd_disc *proto, int ntracks, char **names,
+                       int minutes, int keep_order)
+{
+   int capacity, d, t, n, secs, ndiscs;
+   int *order, *disc_of, *used, *count;
+   struct vcd_disc *disc;
+   double t_start;
+
+   t_start = now();
+   capacity = minutes*60*75;
+
+   /* With -s the ISO track must hold the scan points of a full disc */
+
+   if(scan_data)
+      plan_scan_points = scan_capacity((long)capacity*2324, MAX_MPEG_FILES);
+
+   plan_secs = (int *) malloc(ntracks*sizeof(int));
+   order     = (int *) malloc(ntracks*sizeof(int));
+   disc_of   = (int *) malloc(ntracks*sizeof(int));
+   used      = (int *) malloc(ntracks*sizeof(int));
+   count     = (int *) malloc(ntracks*sizeof(int));
+   if(!plan_secs || !order || !disc_of || !used || !count)
+   {
+      fprintf(stderr,"Out of memory\n");
+      exit(1);
+   }
+
+   /* Footprint of every track */
+
+   for(t=0;t<ntracks;t++)
+   {
+      secs = count_mpeg_secs(names[t]);
+      if(secs<0)
+      {
+         fprintf(stderr,"Can not plan with %s\n",names[t]);
+         exit(1);
+      }
+      if(secs<=150)
+      {
+         fprintf(stderr,"Not enough MPEG data in %s\n",names[t]);
+         exit(1);
+      }
+
+      plan_secs[t] = secs + TRACK_GAP_SECS;
+      order[t] = t;
+
+      if(150 + plan_iso_size(proto,1) + plan_secs[t] > capacity)
+      {
+         fprintf(stderr,"%s does not fit on a disc of %d minutes\n",
+                        names[t],minutes);
+         exit(1);
+      }
+   }
+
+   if(!keep_order) qsort(order,ntracks,sizeof(int),cmp_plan_tracks);
+
+   /* Put every track on the first disc with enough room left,
+      keeping the order only the last disc is tried */
+
+   ndiscs = 0;
+
+   for(n=0;n<ntracks;n++)
+   {
+      t = order[n];
+
+      for(d=(keep_order && ndiscs>0) ? ndiscs-1 : 0; d<ndiscs; d++)
+         if(count[d]<MAX_MPEG_FILES &&
+            150 + plan_iso_size(proto,count[d]+1) + used[d] + plan_secs[t] <= capacity)
+            break;
+
+      if(d==ndiscs)
+      {
+         used[d] = count[d] = 0;
+         ndiscs++;
+      }
+
+      disc_of[t] = d;
+      used[d] += plan_secs[t];
+      count[d]++;
+   }
+
+   /* Make the discs for master_batch_disc() */
+
+   batch_disc = (struct vcd_disc *) malloc(ndiscs*sizeof(struct vcd_disc));
+   if(batch_disc==0)
+   {
+      fprintf(stderr,"Out of memory\n");
+      exit(1);
+   }
+   num_batch_discs = ndiscs;
+
+   for(d=0;d<ndiscs;d++)
+   {
+      disc = batch_disc + d;
+      *disc = *proto;
+      disc->image = disc_name(proto->image,d+1);
+      disc->toc   = disc_name(proto->toc,d+1);
+      disc->num_MPEG_files = 0;
+      for(t=0;t<ntracks;t++)
+         if(disc_of[t]==d) disc->MPEG_name[disc->num_MPEG_files++] = names[t];
+   }
+
+   /* Print the plan */
+
+   printf("Plan: %d tracks on %d discs of %d minutes (%d sectors), %.1f ms\n",
+          ntracks,ndiscs,minutes,capacity,(now()-t_start)*1000.);
+
+   for(d=0;d<ndiscs;d++)
+   {
+      disc = batch_disc + d;
+      secs = 150 + plan_iso_size(proto,count[d]) + used[d];
+      printf("Disc %d: %s, %d tracks, %d sectors (",
+             d+1,disc->image,disc->num_MPEG_files,secs);
+      print_msf(secs);
+      printf("), %d sectors free\n",capacity-secs);
+
+      for(n=0,t=0;t<ntracks;t++)
+      {
+         if(disc_of[t]!=d) continue;
+         printf("   Track %2d: %s, %d sectors (",n+2,names[t],plan_secs[t]);
+         print_msf(plan_secs[t]);
+         printf(")\n");
+         n++;
+      }
+   }
+
+   free(order);
+   free(disc_of);
+   free(used);
+   free(count);
+}
+
+/*
+   Preflight (--preflight):
+
+   Parse all MPEG files with read_mpeg_sec() like master_disc() does,
+   but without encoding or writing anything, one worker process per
+   file. A file fails if it can not be parsed up to its end or has
+   less than 150 sectors, so bad input is found before any disc
+   is mastered.
+*/
+
+static char **check_name;
+
+static int check_mpeg(int n)
+{
+   FILE *fd;
+   int i, id, nvideo, naudio;
+
+   fd = fopen(check_name[n],"rb");
+   if(fd==0)
+   {
+      fprintf(stderr,"Can not open file %s\n",check_name[n]);
+      perror("open");
+      return 1;
+   }
+
+   tag = 0;
+   mpeg_error = 0;
+   nvideo = naudio = 0;
+
+   for(i=0;;i++)
+   {
+      id = read_mpeg_sec(fd,data);
+      if(id<0) break;
+      if(id==0xe0) nvideo++;
+      if(id==0xc0) naudio++;
+      if(tag==EOF_INDICATOR) break;
+   }
+
+   fclose(fd);
+
+   if(id<0 || mpeg_error) return 1;
+
+   if(i<150)
+   {
+      fprintf(stderr,"%s: Not enough MPEG data\n",check_name[n]);
+      return 1;
+   }
+
+   printf("%s: %d sectors, %d video, %d audio\n",check_name[n],i+1,nvideo,naudio);
+
+   return 0;
+}
+
+static int preflight(int num, char **names, int nworkers)
+{
+   int *status, n, failed;
+
+   status = (int *) malloc(num*sizeof(int));
+   if(status==0)
+   {
+      fprintf(stderr,"Out of memory\n");
+      exit(1);
+   }
+
+   check_name = names;
+   failed = run_jobs(num, nworkers, check_mpeg, status);
+
+   for(n=0;n<num;n++)
+      if(status[n]!=0) fprintf(stderr,"%s: FAILED\n",names[n]);
+
+   free(status);
+
+   return failed;
+}
+
+/*
+   Patch mode (--patch):
+
+   Change the volume id, the album id or volume number of INFO.VCD
+   or entry points of ENTRIES.VCD in a finished image. Only these
+   sectors are read and written again, their EDC and P/Q parity is
+   updated from the bytes changed (see update_L2() in edc_ecc.c)
+   and checked against a complete encoding before anything is written.
+*/
+
+#define PVD_SECTOR     16
+#define INFO_SECTOR   150
+#define ENTRIES_SECTOR 151
+
+static char *patch_album;
+static int patch_volume, patch_volume_count;
+static int num_patch_entries;
+static int patch_entry[MAX_ENTRIES], patch_entry_sector[MAX_ENTRIES];
+
+static void read_sector(int fd, char *image, int rec, unsigned char *sec)
+{
+   if(lseek(fd,(off_t)rec*2352,SEEK_SET)<0 || read(fd,sec,2352)!=2352)
+   {
+      fprintf(stderr,"Can not read sector %d of %s\n",rec,image);
+      exit(1);
+   }
+}
+
+static void write_sector(int fd, char *image, int rec, unsigned char *sec)
+{
+   if(lseek(fd,(off_t)rec*2352,SEEK_SET)<0 || write(fd,sec,2352)!=2352)
+   {
+      fprintf(stderr,"Can not write sector %d of %s\n",rec,image);
+      perror("write");
+      exit(1);
+   }
+}
+
+static void patch_field(unsigned char *sec, int offset, char *str, int len)
+{
+   /* Set a blank padded string in the data of a Form 1 sector */
+
+   unsigned char field[128];
+   int i, l;
+
+   l = strlen(str);
+   if(l>len)
+   {
+      fprintf(stderr,"%s is longer than %d characters\n",str,len);
+      exit(1);
+   }
+   for(i=0;i<len;i++) field[i] = (i<l) ? str[i] : ' ';
+
+   update_L2(sec, MODE_2_FORM_1, 24+offset, field, len);
+}
+
+static void patch_number(unsigned char *sec, int offset, int num)
+{
+   unsigned char field[2];
+
+   field[0] = num>>8;
+   field[1] = num&0xff;
+   update_L2(sec, MODE_2_FORM_1, 24+offset, field, 2);
+}
+
+static void patch_image(char *image, char *volume_id)
+{
+   unsigned char sec[3][2352], check[2352], mpeg[2352], *ent, msf[3];
+   static int rec[3] = { PVD_SECTOR, INFO_SECTOR, ENTRIES_SECTOR };
+   int fd, i, n, num, track, m, s, f, last;
+   double t_start;
+
+   t_start = now();
+
+   fd = open(image, O_RDWR);
+   if(fd<0)
+   {
+      fprintf(stderr,"Can not open %s\n",image);
+      perror("open");
+      exit(1);
+   }
+
+   for(i=0;i<3;i++) read_sector(fd, image, rec[i], sec[i]);
+
+   if(sec[0][24]!=1 || memcmp(sec[0]+25,"CD001",5)!=0 ||
+      memcmp(sec[1]+24,"VIDEO_CD",8)!=0 || memcmp(sec[2]+24,"ENTRYVCD",8)!=0)
+   {
+      fprintf(stderr,"%s is not a VCD image made by mkvcdfs\n",image);
+      exit(1);
+   }
+
+   if(volume_id) patch_field(sec[0], 40, volume_id, 32);
+
+   if(patch_album) patch_field(sec[1], 10, patch_album, 16);
+   if(patch_volume_count) patch_number(sec[1], 26, patch_volume_count);
+   if(patch_volume) patch_number(sec[1], 28, patch_volume);
+
+   /* An entry point keeps its track, the new sector must contain
+      MPEG data (Form 2, channel != 0). The file number is not checked,
+      other tools use 1 for all tracks */
+
+   ent = sec[2]+24;
+   num = (ent[10]<<8) | ent[11];
+
+   for(i=0;i<num_patch_entries;i++)
+   {
+      n = patch_entry[i];
+      if(n<1 || n>num)
+      {
+         fprintf(stderr,"%s has no entry point %d\n",image,n);
+         exit(1);
+      }
+      track = FROM_BCD(ent[12+4*(n-1)]);
+
+      read_sector(fd, image, patch_entry_sector[i], mpeg);
+      if(mpeg[15]!=2 || (mpeg[18]&0x20)==0 || mpeg[17]==0)
+      {
+         fprintf(stderr,"Sector %d holds no MPEG data (entry point %d, track %d)\n",
+                 patch_entry_sector[i],n,track);
+         exit(1);
+      }
+
+      f = patch_entry_sector[i]+150;
+      s = f/75;
+      f = f%75;
+      m = s/60;
+      s = s%60;
+      msf[0] = BCD(m);
+      msf[1] = BCD(s);
+      msf[2] = BCD(f);
+      update_L2(sec[2], MODE_2_FORM_1, 24+12+4*(n-1)+1, msf, 3);
+   }
+
+   /* The entries must still be in ascending order */
+
+   last = -1;
+   for(n=0;n<num;n++)
+   {
+      m = ((FROM_BCD(ent[13+4*n])*60 + FROM_BCD(ent[14+4*n]))*75 + FROM_BCD(ent[15+4*n]));
+      if(m<=last)
+      {
+         fprintf(stderr,"Entry point %d is not after entry point %d\n",n+1,n);
+         exit(1);
+      }
+      last = m;
+   }
+
+   /* Check against a complete encoding, the image is not changed
+      if one of the sectors is wrong */
+
+   for(i=0;i<3;i++)
+   {
+      memcpy(check, sec[i], 2352);
+      do_encode_L2(check, MODE_2_FORM_1, rec[i]+150);
+      if(memcmp(check, sec[i], 2352)!=0)
+      {
+         fprintf(stderr,"Sector %d of %s is not encoded correctly\n",rec[i],image);
+         exit(1);
+      }
+   }
+
+   for(i=0;i<3;i++) write_sector(fd, image, rec[i], sec[i]);
+
+   if(close(fd)<0)
+   {
+      perror("close");
+      exit(1);
+   }
+
+   printf("%s patched in %.1f ms\n",image,(now()-t_start)*1000.);
+}
+
+static time_t parse_epoch(char *str)
+{
+   char *end;
+   long epoch;
+
+   epoch = strtol(str,&end,10);
+   if(*str==0 || *end!=0 || epoch<0)
+   {
+      fprintf(stderr,"Invalid source date epoch %s\n",str);
+      exit(1);
+   }
+   return epoch;
+}
+
+static void usage(char *prog)
+{
+   fprintf(stderr,"Usage: %s [-o image] [-t toc] [-V volume-id] [-f file] ... [-e secs]\n"
+                  "          [-s] [--dry-run] [--stats file] [--source-date-epoch secs] MPEG-files ....\n",prog);
+   fprintf(stderr,"       %s --mux [options as above, no --dry-run] video1 audio1 video2 audio2 ....\n",prog);
+   fprintf(stderr,"       %s -b job-file [-j workers | --variants | --dry-run] [--stats file]\n"
+                  "          [--source-date-epoch secs]\n",prog);
+   fprintf(stderr,"       %s --plan minutes [--keep-order] [--dry-run] [-j workers]\n"
+                  "          [other options as above] MPEG-files ....\n",prog);
+   fprintf(stderr,"       %s --preflight [-j workers] MPEG-files ....\n",prog);
+   fprintf(stderr,"       %s --preflight [-j workers] -b job-file\n",prog);
+   fprintf(stderr,"       %s --patch image [-V volume-id] [--album id] [--volume n/count]\n"
+                  "          [--entry n=sector] ...\n",prog);
+   exit(1);
+}
+
+main(int argc, char **argv)
+{
+   struct vcd_disc disc;
+   char *job_file = 0, *patch = 0, *volume_id = 0;
+   int nworkers = 0;
+   int plan_minutes = 0, keep_order = 0, dry_run = 0, check = 0, mux = 0;
+   int disc_options = 0;  /* -o, -t, -V or -f given */
+   char **names;
+   int i, n, failed;
+
+   memset(&disc,0,sizeof(disc));
+   disc.image     = BINARY_OUTPUT_FILE;
+   disc.toc       = VCD_TOC_FILE;
+   disc.volume_id = CD_VOLUME_ID;
+
+   /* "-" is not an option but stdin (--mux) */
+
+   for(i=1;i<argc && argv[i][0]=='-' && argv[i][1];i++)
+   {
+      /* Options without a value */
+
+      if(strcmp(argv[i],"--keep-order")==0)
+      {
+         keep_order = 1;
+         continue;
+      }
+      if(strcmp(argv[i],"--dry-run")==0)
+      {
+         dry_run = 1;
+         continue;
+      }
+      if(strcmp(argv[i],"--preflight")==0)
+      {
+         check = 1;
+         continue;
+      }
+      if(strcmp(argv[i],"-s")==0)
+      {
+         scan_data = 1;
+         continue;
+      }
+      if(strcmp(argv[i],"--variants")==0)
+      {
+         variants = 1;
+         continue;
+      }
+      if(strcmp(argv[i],"--mux")==0)
+      {
+         mux = 1;
+         continue;
+      }
+
+      if(i+1>=argc) usage(argv[0]);
+
+      if(strcmp(argv[i],"-o")==0 || strcmp(argv[i],"-t")==0 ||
+         strcmp(argv[i],"-V")==0 || strcmp(argv[i],"-f")==0) disc_options = 1;
+
+      if(strcmp(argv[i],"-o")==0)
+         disc.image = argv[++i];
+      else if(strcmp(argv[i],"-t")==0)
+         disc.toc = argv[++i];
+      else if(strcmp(argv[i],"-V")==0)
+         disc.volume_id = volume_id = argv[++i];
+      else if(strcmp(argv[i],"-f")==0)
+         add_file(&disc, argv[++i]);
+      else if(strcmp(argv[i],"-b")==0)
+         job_file = argv[++i];
+      else if(strcmp(argv[i],"-j")==0)
+         nworkers = atoi(argv[++i]);
+      else if(strcmp(argv[i],"-e")==0)
+      {
+         entry_interval = atoi(argv[++i]);
+         if(entry_interval<=0) usage(argv[0]);
+      }
+      else if(strcmp(argv[i],"--stats")==0)
+         stats_file = argv[++i];
+      else if(strcmp(argv[i],"--source-date-epoch")==0)
+         source_date_epoch = parse_epoch(argv[++i]);
+      else if(strcmp(argv[i],"--plan")==0)
+      {
+         plan_minutes = atoi(argv[++i]);
+         if(plan_minutes<=0) usage(argv[0]);
+      }
+      else if(strcmp(argv[i],"--patch")==0)
+         patch = argv[++i];
+      else if(strcmp(argv[i],"--album")==0)
+         patch_album = argv[++i];
+      else if(strcmp(argv[i],"--volume")==0)
+      {
+         if(sscanf(argv[++i],"%d/%d",&patch_volume,&patch_volume_count)!=2 ||
+            patch_volume<1 || patch_volume>patch_volume_count ||
+            patch_volume_count>65535) usage(argv[0]);
+      }
+      else if(strcmp(argv[i],"--entry")==0)
+      {
+         if(num_patch_entries>=MAX_ENTRIES ||
+            sscanf(argv[++i],"%d=%d",&patch_entry[num_patch_entries],
+                   &patch_entry_sector[num_patch_entries])!=2) usage(argv[0]);
+         num_patch_entries++;
+      }
+      else
+         usage(argv[0]);
+   }
+
+   if(keep_order && !plan_minutes) usage(argv[0]);
+   if(variants && (!job_file || check)) usage(argv[0]);
+
+   /* The job file describes every disc, the options for a single disc
+      would be ignored */
+
+   if(job_file && disc_options) usage(argv[0]);
+   if(mux && (job_file || plan_minutes || dry_run || check || patch)) usage(argv[0]);
+   if((patch_album || patch_volume || num_patch_entries) && !patch) usage(argv[0]);
+
+   if(patch)
+   {
+      if(i<argc) usage(argv[0]);
+      patch_image(patch, volume_id);
+      exit(0);
+   }
+
+   if(check)
+   {
+      /* Check the MPEG files given, or all tracks of the job file */
+
+      if(job_file)
+      {
+         if(i<argc) usage(argv[0]);
+         read_job_file(job_file);
+
+         for(n=0,i=0;i<num_batch_discs;i++) n += batch_disc[i].num_MPEG_files;
+         names = (char **) malloc(n*sizeof(char *));
+         if(names==0)
+         {
+            fprintf(stderr,"Out of memory\n");
+            exit(1);
+         }
+         for(n=0,i=0;i<num_batch_discs;i++)
+         {
+            memcpy(names+n,batch_disc[i].MPEG_name,
+                   batch_disc[i].num_MPEG_files*sizeof(char *));
+            n += batch_disc[i].num_MPEG_files;
+         }
+      }
+      else
+      {
+         if(i>=argc) usage(argv[0]);
+         names = argv+i;
+         n = argc-i;
+      }
+
+      if(nworkers<=0) nworkers = num_cpus();
+
+      failed = preflight(n, names, nworkers);
+      if(failed)
+      {
+         fprintf(stderr,"%d of %d files failed\n",failed,n);
+         exit(1);
+      }
+      printf("All %d files passed\n",n);
+      exit(0);
+   }
+
+   if(source_date_epoch<0 && getenv("SOURCE_DATE_EPOCH"))
+      source_date_epoch = parse_epoch(getenv("SOURCE_DATE_EPOCH"));
+
+   /* Statistics of every disc are appended to the stats file,
+      so start with an empty one */
+
+   if(stats_file && strcmp(stats_file,"-")!=0)
+   {
+      n = open(stats_file, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+      if(n<0)
+      {
+         fprintf(stderr,"Can not open %s\n",stats_file);
+         perror("open");
+         exit(1);
+      }
+      close(n);
+   }
+
+   if(job_file || plan_minutes)
+   {
+      /* Batch mode, master all discs of the job file or of the plan,
+         one worker per processor unless told otherwise */
+
+      if(job_file)
+      {
+         if(i<argc || plan_minutes) usage(argv[0]);
+         read_job_file(job_file);
+      }
+      else
+      {
+         if(i>=argc) usage(argv[0]);
+         plan_discs(&disc, argc-i, argv+i, plan_minutes, keep_order);
+      }
+
+      if(dry_run)
+      {
+         for(n=0;n<num_batch_discs;n++) dry_run_disc(batch_disc+n);
+         exit(0);
+      }
+
+      if(variants)
+      {
+         /* One after the other, every track is encoded only once */
+
+         for(n=0;n<num_batch_discs;n++) master_disc(batch_disc+n);
+         exit(0);
+      }
+
+      if(nworkers<=0) nworkers = num_cpus();
+
+      printf("Mastering %d discs with %d workers\n",num_batch_discs,
+             (nworkers<num_batch_discs) ? nworkers : num_batch_discs);
+
+      failed = run_jobs(num_batch_discs, nworkers, master_batch_disc, 0);
+      if(failed)
+      {
+         fprintf(stderr,"%d of %d discs failed\n",failed,num_batch_discs);
+         exit(1);
+      }
+      exit(0);
+   }
+
+   if(i>=argc) usage(argv[0]);
+
+   if(mux)
+   {
+      /* Pairs of video and audio streams */
+
+      if((argc-i)%2) usage(argv[0]);
+
+      if((argc-i)/2>MAX_MPEG_FILES)
+      {
+         fprintf(stderr,"Maximum of %d MPEG files exceeded!\n",MAX_MPEG_FILES);
+         exit(1);
+      }
+
+      disc.num_MPEG_files = (argc-i)/2;
+      for(n=0;n<disc.num_MPEG_files;n++)
+      {
+         disc.MPEG_name[n]  = argv[i+2*n];
+         disc.audio_name[n] = argv[i+2*n+1];
+      }
+
+      master_disc(&disc);
+      exit(0);
+   }
+
+   if(argc-i>MAX_MPEG_FILES)
+   {
+      fprintf(stderr,"Maximum of %d MPEG files exceeded!\n",MAX_MPEG_FILES);
+      exit(1);
+   }
+
+   disc.num_MPEG_files = argc-i;
+   for(n=0;n<disc.num_MPEG_files;n++) disc.MPEG_name[n] = argv[i+n];
 
-   mk_vcd_iso_fs(num_MPEG_files, MPEG_extent, MPEG_size);
+   if(dry_run)
+      dry_run_disc(&disc);
+   else
+      master_disc(&disc);
+   exit(0);
 }
@@ -0,0 +1,28 @@
+/* Functions shared between mkvcdfs.c and vcdisofs.c */
+
+#include <time.h>
+
+/* mkvcdfs.c: output CDROM XA Mode 2 Form 1/2 records to the image */
+
+void output_form1(int rec, char *data);
+void output_form2(int rec, int h1, int h2, int h3, int h4, unsigned char *data);
+
+/* Entry points of ENTRIES.VCD: CD track number (2 for the first
+   MPEG track) and sector, at most MAX_ENTRIES fit into the file */
+
+#define MAX_ENTRIES 500
+
+struct vcd_entry {
+   int track;
+   int extent;
+};
+
+/* vcdisofs.c: make the first track with the ISO 9660 file system,
+   vcd_iso_layout returns its size in blocks, vcd_iso_scandata
+   sets the contents of EXT/SCANDATA.DAT */
+
+int  vcd_iso_layout(int num_MPEG_files, int scan_points, int num_paths, char **path);
+void vcd_iso_scandata(int num, int *sector);
+void mk_vcd_iso_fs(int num_MPEG_files, int *MPEG_extent, int *MPEG_size,
+                   int num_entries, struct vcd_entry *entry,
+                   char *volume_id, time_t T);
@@ -0,0 +1,2609 @@
+/*
+
+   mplex.c - MPEG system stream multiplexer for video CDs
+
+   The multiplexer of vcdmplex, mkvcdfs --mux uses it to master
+   elementary streams without an intermediate system stream
+   (see mplex.h).
+
+   Copyright (C) 2000 Rainer Johanni <Rainer@Johanni.de>
+
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include "jobpool.h"
+#include "mplex.h"
+#include "defaults.h"
+
+/* Sector size for multiplexed output - don't change, it is the sector
+   size of a Video CD */
+
+#define SECTOR_SIZE 2324
+
+/* Buffer sizes of the MPEG-1 system target decoder (STD) for video
+   and audio, they are given in the system headers */
+
+#define VIDEO_BUFFER_SIZE (46*1024)
+#define AUDIO_BUFFER_SIZE (32*128)
+
+// #define AUDIO_BYTES (SECTOR_SIZE-25)
+#define AUDIO_BYTES 2279
+
+/* Markers for MPEG System, timestamps */
+
+#define MARKER_DTS               1
+#define MARKER_SCR               2 
+#define MARKER_JUST_PTS          2
+#define MARKER_PTS               3
+
+/* File descriptors */
+
+static int mpegin;
+static FILE *audioin;
+static int sysout;
+
+/* Data returned by get_m1v_frame() */
+
+static long MPEG_frame_no;
+static long MPEG_frame_seq;
+static long MPEG_frame_type;
+static long MPEG_frame_len;
+
+/* Slices of the frame: number and sum of their quantizer_scale */
+
+static long MPEG_frame_slices;
+static long MPEG_frame_qscale;
+
+/* Internal data for get_m1v_frame(), lasttag holds the start code
+   at the current position of the video stream (0 before the first call) */
+
+static long lasttag, gop_start_frame, frame_no, seqhdr_seen;
+
+/* The video stream is read in big blocks, start codes are searched
+   with memchr() and the data in front of them is copied at once.
+   The headers behind a start code are read in vin, VIN_KEEP bytes
+   of it are kept when the next block is read */
+
+#define VIN_BLOCK (1024*1024)
+#define VIN_KEEP  16
+
+static unsigned char vin[VIN_BLOCK+VIN_KEEP];
+static int vin_pos, vin_len;
+
+/* Output: the header bytes of a pack (pack, system and packet header)
+   are put together from templates in packet[], the payload is not
+   copied but written from where it is (the video and audio rings).
+   The packs are collected and written with one writev() call */
+
+#define PACK_BATCH   64
+#define PACK_HDR_MAX 48   /* header bytes of a pack at most */
+#define PACK_IOV     7    /* header, 4 pieces of payload, trailer, fill */
+
+static unsigned char pack_hdr[PACK_BATCH][PACK_HDR_MAX+8];
+static struct iovec pack_iov[PACK_BATCH*PACK_IOV];
+static int num_batch_packs, num_iov;
+
+/* Templates and bytes for filling up a sector */
+
+static unsigned char pack_template[12], system_template[2][15];
+static unsigned char zero_fill[SECTOR_SIZE], pad_fill[SECTOR_SIZE];
+
+/* Header of the current pack, number of bytes in the pack
+   and the payload added by add_payload() */
+
+static unsigned char *packet;
+static long npb;
+static int pack_hdr_len, num_payload;
+static unsigned char *payload[4];
+static int payload_len[4];
+
+/*
+   The video frames are parsed and the audio is read in threads of
+   their own, the multiplexer (main thread) gets them through rings:
+   the producer fills slot put%size when put-freed < size,
+   the consumer takes slot got%size when got < put and gives it
+   back later with ring_release() (when it is written out).
+   A producer waiting for a free slot gives up when stop is set.
+*/
+
+struct ring {
+   int size;
+   long put, got, freed;
+   int stop;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+};
+
+/* A frame parsed by the video thread: it is put into the ring as soon
+   as its picture header is read, len grows while the rest is read */
+
+#define VIDEO_RING 8
+
+struct frame {
+   long long pos;             /* of the first byte in the video data */
+   long len, no, seq, type;
+   int done;                  /* len is final */
+   int end;                   /* 1 after the last frame */
+};
+
+/* A packet of audio data read by the audio thread, the audio ring
+   must be bigger than the packs written at once.
+   The frames starting in the packet are numbered from the start of
+   the stream, their ends are byte positions in the audio data */
+
+#define AUDIO_RING (2*PACK_BATCH)
+#define AUDIO_FRAMES_MAX 32       /* frames starting in a packet at most */
+
+struct audio_packet {
+   unsigned char data[AUDIO_BYTES];
+   int len;
+   int eof;                       /* last packet */
+   int nframes;
+   long first;                    /* number of the first frame */
+   long long end[AUDIO_FRAMES_MAX];
+};
+
+static struct ring video_ring = { VIDEO_RING, 0, 0, 0, 0,
+                                  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+static struct ring audio_ring = { AUDIO_RING, 0, 0, 0, 0,
+                                  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static pthread_t video_tid, audio_tid;
+
+static struct frame video_frames[VIDEO_RING];
+static struct audio_packet audio_packets[AUDIO_RING];
+
+/* The frame being read by the video thread */
+
+static struct frame *cur_frame;
+
+/*
+   The video data (the frames one after the other, with the inserted
+   sequence headers) goes through a ring of VSEG_SIZE byte segments,
+   segment k of the data is kept in vseg[k%VSEG_MAX]. The segments are
+   allocated when they are needed first, so no more memory than
+   MAX_VIDEO_BUFFER (defaults.h) is used, however big the frames are.
+   The video thread waits for a free segment, the multiplexer gives the
+   bytes back when the packs with them are written.
+   The positions are protected by the lock of the video ring.
+*/
+
+#define VSEG_SIZE (64*1024)
+#define VSEG_MAX  (MAX_VIDEO_BUFFER/VSEG_SIZE < 2 ? 2 : MAX_VIDEO_BUFFER/VSEG_SIZE)
+
+static unsigned char *vseg[VSEG_MAX];
+static long long vbuf_put;    /* bytes put by the video thread */
+static long long vbuf_used;   /* bytes put into packs by the multiplexer */
+static long long vbuf_freed;  /* bytes given back */
+
+/* The video data is kept only while multiplexing (not for preflight) */
+
+static int store_video;
+
+/* Audio packets in the packs not written so far,
+   frames of the video ring taken by next_frame() */
+
+static int batch_audio_packets, frames_held;
+
+/* With a pack sink (mkvcdfs) the packs are handed over one by one.
+   The last one is held back, since the ISO 11172 end code goes into
+   it if there is room (where read_mpeg_sec() of mkvcdfs puts it) */
+
+static pack_sink sink;
+static unsigned char sink_buf[2][SECTOR_SIZE];
+static int sink_held, sink_len;
+
+/* Wait for a free slot and return its number, -1 if stopped (producer) */
+
+static int ring_wait_free(struct ring *r)
+{
+   int n;
+
+   pthread_mutex_lock(&r->lock);
+   while(r->put-r->freed >= r->size && !r->stop) pthread_cond_wait(&r->cond,&r->lock);
+   n = r->stop ? -1 : r->put % r->size;
+   pthread_mutex_unlock(&r->lock);
+
+   return n;
+}
+
+/* The slot returned by ring_wait_free() is filled (producer) */
+
+static void ring_put(struct ring *r)
+{
+   pthread_mutex_lock(&r->lock);
+   r->put++;
+   pthread_cond_broadcast(&r->cond);
+   pthread_mutex_unlock(&r->lock);
+}
+
+/* Wait for the next filled slot and return its number (consumer) */
+
+static int ring_get(struct ring *r)
+{
+   int n;
+
+   pthread_mutex_lock(&r->lock);
+   while(r->got >= r->put) pthread_cond_wait(&r->cond,&r->lock);
+   n = r->got++ % r->size;
+   pthread_mutex_unlock(&r->lock);
+
+   return n;
+}
+
+/* Wait for the next filled slot and return its number
+   without taking it (consumer) */
+
+static int ring_peek(struct ring *r)
+{
+   int n;
+
+   pthread_mutex_lock(&r->lock);
+   while(r->got >= r->put) pthread_cond_wait(&r->cond,&r->lock);
+   n = r->got % r->size;
+   pthread_mutex_unlock(&r->lock);
+
+   return n;
+}
+
+/* Start a ring empty (no thread may use it) */
+
+static void ring_reset(struct ring *r)
+{
+   r->put = r->got = r->freed = 0;
+   r->stop = 0;
+}
+
+/* Make the producer give up (consumer) */
+
+static void ring_stop(struct ring *r)
+{
+   pthread_mutex_lock(&r->lock);
+   r->stop = 1;
+   pthread_cond_broadcast(&r->cond);
+   pthread_mutex_unlock(&r->lock);
+}
+
+/* Give back the oldest n slots taken with ring_get() (consumer) */
+
+static void ring_release(struct ring *r, int n)
+{
+   if(n<=0) return;
+
+   pthread_mutex_lock(&r->lock);
+   r->freed += n;
+   pthread_cond_broadcast(&r->cond);
+   pthread_mutex_unlock(&r->lock);
+}
+
+/* Put len bytes at data behind the video data (video thread) */
+
+static void vbuf_append(unsigned char *data, long len)
+{
+   unsigned char **seg;
+   long off, n;
+
+   while(len>0)
+   {
+      seg = vseg + (vbuf_put/VSEG_SIZE) % VSEG_MAX;
+      off = vbuf_put % VSEG_SIZE;
+
+      if(off==0)
+      {
+         /* Wait until the segment is given back */
+
+         pthread_mutex_lock(&video_ring.lock);
+         while(vbuf_put/VSEG_SIZE - vbuf_freed/VSEG_SIZE >= VSEG_MAX)
+            pthread_cond_wait(&video_ring.cond,&video_ring.lock);
+         pthread_mutex_unlock(&video_ring.lock);
+
+         if(*seg==0) *seg = (unsigned char *) malloc(VSEG_SIZE);
+         if(*seg==0)
+         {
+            fprintf(stderr,"Out of memory\n");
+            exit(1);
+         }
+      }
+
+      n = VSEG_SIZE-off;
+      if(n>len) n = len;
+      memcpy(*seg+off,data,n);
+      data += n;
+      len  -= n;
+
+      pthread_mutex_lock(&video_ring.lock);
+      vbuf_put += n;
+      cur_frame->len += n;
+      pthread_cond_broadcast(&video_ring.cond);
+      pthread_mutex_unlock(&video_ring.lock);
+   }
+}
+
+/* The picture header of the frame is read (video thread),
+   the data in front of it belongs to the frame, too */
+
+static void frame_begin()
+{
+   cur_frame->no   = MPEG_frame_no;
+   cur_frame->seq  = MPEG_frame_seq;
+   cur_frame->type = MPEG_frame_type;
+   ring_put(&video_ring);
+}
+
+/* The MPEG system clock counter */
+
+static long system_clock;
+
+/* Bitrates */
+
+static int AudioBitRate; /* in Kbit/s */
+static int AudioFreq;    /* in Hz */
+static int VideoBitRate; /* in units of 400 bit/s */
+static int MuxRate;      /* in units of 400 bit/s */
+
+
+static double rates[16] = { 0, 23.976, 24.0, 25.0, 29.97, 30.0, 50.0, 59.94, 60.0, 0, 0, 0, 0, 0, 0, 0 };
+
+static int FrameRate, mpeg2, twofields;
+
+/* MPEG-2 pictures higher than 2800 lines have an extension in the slices */
+
+static int tall_pictures;
+
+static unsigned char SeqHdr[256], SeqExt[10];
+static int SeqHdrLen;
+
+/* Don't print the stream properties (preflight) */
+
+static int quiet = 0;
+
+/*
+   Bit reader for the header fields: the next bits of the data are
+   kept in a 64 bit window, MSB first, which is refilled with 64 bit
+   big endian loads. Data past the end reads as 0 bits.
+*/
+
+typedef unsigned long long bitwin_t;
+
+struct bitreader {
+   unsigned char *data, *end;
+   bitwin_t window;
+   int bits;                  /* number of valid bits in window */
+};
+
+static void br_refill(struct bitreader *br)
+{
+   bitwin_t v;
+   unsigned char *p = br->data;
+   int n;
+
+   if(br->end-p>=8)
+   {
+      /* The bits below the whole bytes taken are taken again
+         by the next refill, or-ing them twice does no harm */
+
+      v = ((bitwin_t)p[0]<<56) | ((bitwin_t)p[1]<<48) | ((bitwin_t)p[2]<<40) |
+          ((bitwin_t)p[3]<<32) | ((bitwin_t)p[4]<<24) | ((bitwin_t)p[5]<<16) |
+          ((bitwin_t)p[6]<< 8) |  (bitwin_t)p[7];
+      n = (64-br->bits)>>3;
+      br->window |= v >> br->bits;
+      br->data   += n;
+      br->bits   += 8*n;
+   }
+   else
+   {
+      while(br->bits<=56 && br->data<br->end)
+      {
+         br->window |= (bitwin_t)*br->data++ << (56-br->bits);
+         br->bits += 8;
+      }
+      if(br->bits<=56) br->bits = 64; /* zeros at the end */
+   }
+}
+
+static void br_init(struct bitreader *br, unsigned char *data, long len)
+{
+   br->data   = data;
+   br->end    = data+len;
+   br->window = 0;
+   br->bits   = 0;
+   br_refill(br);
+}
+
+/* Get the next n bits (1 <= n <= 32) */
+
+static unsigned long br_get(struct bitreader *br, int n)
+{
+   unsigned long res;
+
+   if(br->bits<n) br_refill(br);
+
+   res = (unsigned long)(br->window >> (64-n));
+   br->window <<= n;
+   br->bits -= n;
+
+   return res;
+}
+
+static void br_skip(struct bitreader *br, int n)
+{
+   for(; n>32; n-=32) br_get(br,32);
+   if(n>0) br_get(br,n);
+}
+
+static int vin_fill()
+{
+   /* Keep the bytes not used yet (less than VIN_KEEP) and read the
+      next block, returns 0 at EOF */
+
+   int n, len;
+
+   n = vin_len - vin_pos;
+   memmove(vin, vin+vin_pos, n);
+   vin_pos = 0;
+   vin_len = n;
+
+   /* read() returns what is there, a pipe is not waited for
+      until the block is full */
+
+   len = read(mpegin, vin+n, VIN_BLOCK);
+   if(len<0)
+   {
+      perror("Read MPEG video stream");
+      exit(1);
+   }
+   if(len==0) return 0;
+   vin_len += len;
+
+   return 1;
+}
+
+/* Have at least n (<= VIN_KEEP) bytes at the current position in vin,
+   returns 0 if the stream ends before */
+
+static int vin_need(int n)
+{
+   while(vin_len-vin_pos<n)
+      if(!vin_fill()) return 0;
+
+   return 1;
+}
+
+/*
+   vin_byte: byte n of the video stream for open_m1v(),
+             the stream is read into vin and nothing is consumed
+
+   returns EOF at the end of the stream (or if the headers don't fit into vin)
+*/
+
+static int vin_byte(int n)
+{
+   int len;
+
+   while(n>=vin_len)
+   {
+      if(vin_len>=VIN_BLOCK) return EOF;
+
+      len = read(mpegin, vin+vin_len, VIN_BLOCK-vin_len);
+      if(len<=0) return EOF;
+      vin_len += len;
+   }
+
+   return vin[n];
+}
+
+/*
+   openm1v: Open a MPEG 1 video stream, check params,
+            save SeqHdr and SeqExt (for MPEG-2)
+ */
+
+static void open_m1v(char *filename)
+{
+   int HorSize, VerSize, AspectRatio, marker_bit, VBVBufferSize;
+   int CSPF, ProgSeq;
+   int c, i, pos;
+   unsigned int tag;
+   struct bitreader br;
+
+   /* "-" is stdin */
+
+   if(strcmp(filename,"-")==0)
+      mpegin = 0;
+   else
+      mpegin = open(filename,O_RDONLY);
+   if(mpegin<0)
+   {
+      fprintf(stderr,"Error opening %s\n",filename);
+      perror("open");
+      exit(1);
+   }
+
+   /* read Sequence header, the headers are read with vin_byte(),
+      so they stay in vin and the stream needs not to be rewound */
+
+   vin_pos = vin_len = 0;
+   pos = 0;
+
+   for(i=0;i<12;i++)
+   {
+      c = vin_byte(pos++);
+      if(c==EOF)
+      {
+         fprintf(stderr,"Error reading %s\n",filename);
+         exit(1);
+      }
+      SeqHdr[i] = c;
+   }
+
+   /* Check if file contains sequence header */
+
+   if(SeqHdr[0]!=0 || SeqHdr[1]!=0 || SeqHdr[2]!=1 || SeqHdr[3]!=0xb3)
+   {
+      fprintf(stderr,"Error: File %s is not a MPEG 1 video stream\n",filename);
+      exit(1);
+   }
+
+   if(!quiet) printf("Opened MPEG 1 file %s\n\n",filename);
+
+   br_init(&br,SeqHdr+4,8);
+   HorSize      = br_get(&br,12);
+   VerSize      = br_get(&br,12);
+   AspectRatio  = br_get(&br, 4);
+   FrameRate    = br_get(&br, 4);
+   VideoBitRate = br_get(&br,18);
+   marker_bit   = br_get(&br, 1);
+   VBVBufferSize= br_get(&br,10);
+   CSPF         = br_get(&br, 1);
+
+   if(!quiet)
+   {
+      printf("Horizontal size: %5d\n",HorSize);
+      printf("Vertical size:   %5d\n",VerSize);
+      printf("Aspect ratio:    %5d\n",AspectRatio);
+      printf("Frame rate:      %5d = %.3f Pictures/sec\n",FrameRate,rates[FrameRate]);
+      printf("bitrate:         %5d = %d bits/sec\n",VideoBitRate,VideoBitRate*400);
+      if(VideoBitRate==0x3ffff) printf("*** This is variable bitrate ***\n");
+      printf("marker bit:      %5d\n",marker_bit);
+      printf("VBV buffer size: %5d\n",VBVBufferSize);
+      printf("CSPF:            %5d\n",CSPF);
+   }
+
+   /* check if we have to load intra or non intra quantizer matrices */
+
+   SeqHdrLen = 12;
+   c = SeqHdr[SeqHdrLen-1];
+   if(c&2) /* Load intra */
+      for(i=0;i<64;i++) SeqHdr[SeqHdrLen++] = vin_byte(pos++);
+
+   c = SeqHdr[SeqHdrLen-1];
+   if(c&1) /* Load non intra */
+      for(i=0;i<64;i++) SeqHdr[SeqHdrLen++] = vin_byte(pos++);
+
+   lasttag = 0;
+   gop_start_frame = 0;
+   frame_no = 0;
+   MPEG_frame_len = 0;
+
+   twofields = 0;
+   mpeg2 = 0;
+   tall_pictures = 0;
+
+   /* Search for MPEG-2 sequence extension header */
+
+   tag = 0xffffffff;
+   while(1)
+   {
+      c = vin_byte(pos++);
+      if(c==EOF)
+      {
+         fprintf(stderr,"Unexpected EOF in header\n");
+         exit(1);
+      }
+      tag = (tag<<8) | c;
+      /* Break if first frame or seq. ext. header is reached */
+      if(tag == 0x100 || tag ==0x1b5) break;
+   }
+
+   if(tag==0x1b5)
+   {
+      if(!quiet) printf("*** this is a MPEG-2 stream ***\n");
+      mpeg2 = 1;
+      SeqExt[0] = 0x00;
+      SeqExt[1] = 0x00;
+      SeqExt[2] = 0x01;
+      SeqExt[3] = 0xb5;
+      for(i=4;i<10;i++)
+      {
+         c = vin_byte(pos++);
+         if(c==EOF)
+         {
+            fprintf(stderr,"Unexpected EOF in header\n");
+            exit(1);
+         }
+         SeqExt[i] = c;
+      }
+      br_init(&br,SeqExt+4,6);
+      br_skip(&br,12);
+      ProgSeq = br_get(&br,1);
+      br_skip(&br,4);
+      tall_pictures = ((br_get(&br,2)<<12) | VerSize) > 2800;
+      if(!quiet) printf("Progressive:     %5d\n",ProgSeq);
+      twofields = (ProgSeq==0);
+      for(i=0;i<10;i++) SeqHdr[SeqHdrLen++] = SeqExt[i];
+   }
+
+   /* The stream starts again with the sequence header in vin */
+
+   vin_pos = 0;
+}
+
+static void put_video(long *nvb, unsigned char *data, long len)
+{
+   /* Append len bytes at data to the frame */
+
+   if(store_video) vbuf_append(data, len);
+   *nvb += len;
+}
+
+static void copy_video(long *nvb, long len)
+{
+   /* Append len bytes at the current position to the frame */
+
+   put_video(nvb, vin+vin_pos, len);
+   vin_pos += len;
+}
+
+/*
+   copy_to_start_code:
+
+   Append the video stream from the current position + 1 up to the
+   next start code (00 00 01 xx) to the frame, the current position is
+   left at the start code.
+
+   returns the start code (0x100 ... 0x1ff),
+           -1 if the stream ends before (all of it is appended)
+*/
+
+static long copy_to_start_code(long *nvb)
+{
+   unsigned char *p, *end;
+
+   /* The first byte belongs to the start code at the current position */
+
+   if(vin_pos>=vin_len && !vin_fill()) return -1;
+   copy_video(nvb, 1);
+
+   while(1)
+   {
+      /* Look for the 01 of a start code with the whole code in vin */
+
+      p   = vin + vin_pos + 2;
+      end = vin + vin_len - 1;
+
+      while(p<end)
+      {
+         p = (unsigned char *) memchr(p, 1, end-p);
+         if(p==0) break;
+
+         if(p[-1]==0 && p[-2]==0)
+         {
+            copy_video(nvb, p-2 - (vin+vin_pos));
+            return 0x100 | p[1];
+         }
+         p++;
+      }
+
+      /* Nothing found, the last 3 bytes may be the start of a start code */
+
+      if(vin_len-vin_pos>3) copy_video(nvb, vin_len-vin_pos-3);
+
+      if(!vin_fill())
+      {
+         copy_video(nvb, vin_len-vin_pos);
+         return -1;
+      }
+   }
+}
+
+/*
+   get_slice_header:
+
+   Read the header of the slice starting (with its start code)
+   at the current position of the video stream, returns the
+   quantizer_scale (nothing else of the header is needed)
+*/
+
+static int get_slice_header()
+{
+   struct bitreader br;
+
+   vin_need(5);
+   br_init(&br,vin+vin_pos,vin_len-vin_pos<8 ? vin_len-vin_pos : 8);
+   br_skip(&br,32);             /* slice_start_code */
+   if(tall_pictures)
+      br_skip(&br,3);           /* slice_vertical_position_extension */
+
+   return br_get(&br,5);
+}
+
+static int get_m1v_frame()
+{
+   long nvb;
+   struct bitreader br;
+
+   /* Number of bytes in the frame */
+
+   nvb = 0;
+
+   if(lasttag == 0)
+   {
+      /* First time called, do some intializations */
+
+      seqhdr_seen = 0;
+
+      /* search for start of first frame, the data in front of it
+         belongs to the first frame */
+
+      do
+      {
+         lasttag = copy_to_start_code(&nvb);
+         if(lasttag<0)
+         {
+            fprintf(stderr,"Unexpected EOF when searching for 1st frame\n");
+            exit(1);
+         }
+      }
+      while (lasttag != 0x100);
+   }
+   else if (lasttag == 0x1b7)
+   {
+      /* We are at the end */
+      return 1;
+   }
+
+   /* At this point we are at the picture header of the new frame,
+      extract temporal reference and frame type */
+
+   vin_need(6);
+   br_init(&br,vin+vin_pos+4,vin_len-vin_pos-4);
+
+   MPEG_frame_no = frame_no;
+   frame_no++;
+   MPEG_frame_seq  = gop_start_frame + br_get(&br,10); /* Real seq no */
+   MPEG_frame_type = br_get(&br, 3);
+   MPEG_frame_slices = 0;
+   MPEG_frame_qscale = 0;
+
+   /* The frame may be multiplexed while the rest of it is read */
+
+   if(store_video) frame_begin();
+
+   /* Search up to the start of the next frame (or end of MPEG) */
+
+   do
+   {
+      lasttag = copy_to_start_code(&nvb);
+      if(lasttag<0)
+      {
+         fprintf(stderr,"Unexpected EOF in MPEG video stream\n");
+         MPEG_frame_len = nvb;
+         return -1;
+      }
+
+      /* check lasttag */
+
+      if(lasttag>=0x101 && lasttag<=0x1af)
+      {
+         MPEG_frame_qscale += get_slice_header();
+         MPEG_frame_slices++;
+      }
+
+      /* If the file contains allready sequence headers within the
+         MPEG stream, set seqhdr_seen to avoid duplicate seq headers */
+
+      if(lasttag == 0x1b3) seqhdr_seen = 1;
+
+      /* If we encounter a GOP header, we have to remember the
+         number of the next frame to come and we will insert
+         a sequence header just before the GOP header */
+
+      if(lasttag == 0x1b8)
+      {
+         gop_start_frame = frame_no;
+
+         if(!seqhdr_seen) put_video(&nvb, SeqHdr, SeqHdrLen);
+
+         seqhdr_seen = 0;
+      }
+
+   }
+   while (lasttag != 0x100 && lasttag != 0x1b7 );
+
+   MPEG_frame_len = nvb;
+
+   return 0;
+}
+
+static unsigned int bitrate_index [3][16] =
+    {{0,32,64,96,128,160,192,224,256,288,320,352,384,416,448,0},
+     {0,32,48,56,64,80,96,112,128,160,192,224,256,320,384,0},
+     {0,32,40,48,56,64,80,96,112,128,160,192,224,256,320,0}};
+
+static double frequency_index [4] = {44.1, 48, 32, 0};
+static unsigned int slots [4] = {12, 144, 0, 0};
+static unsigned int samples [4] = {384, 1152, 0, 0};
+
+static char mode_index [4][15] =
+    { "stereo", "joint stereo", "dual channel", "single channel" };
+static char copyright_index [2][20] =
+    { "no copyright","copyright protected" };
+static char original_index [2][10] =
+    { "copy","original" };
+static char emphasis_index [4][20] =
+    { "none", "50/15 microseconds", "reserved", "CCITT J.17" };
+
+
+/* The audio stream is read frame by frame with mp2_frame() */
+
+#define MAX_AUDIO_FRAME 4096
+
+static int free_len;           /* length of free format frames (w/o padding) */
+static long audio_skipped;     /* bytes skipped in front of the last frame */
+static int audio_rest;         /* bytes after the last complete frame */
+static unsigned char audio_back[MAX_AUDIO_FRAME+4];
+static int audio_nback;        /* bytes put back into the stream */
+
+/*
+   open_mp2: open a MPEG audio stream ("-" is stdin)
+ */
+
+static void open_mp2(char *filename)
+{
+   if(strcmp(filename,"-")==0)
+      audioin = stdin;
+   else
+      audioin = fopen(filename,"r");
+   if(audioin==0)
+   {
+      perror("Open audio file");
+      exit(1);
+   }
+
+   free_len = 0;
+   audio_nback = 0;
+}
+
+static int audio_read(unsigned char *buf, int n)
+{
+   /* Read n bytes, the bytes put back first */
+
+   int i;
+
+   for(i=0;i<n && i<audio_nback;i++) buf[i] = audio_back[i];
+   memmove(audio_back,audio_back+i,audio_nback-i);
+   audio_nback -= i;
+
+   return i + fread(buf+i,1,n-i,audioin);
+}
+
+static void audio_unread(unsigned char *buf, int n)
+{
+   /* Put n bytes back, they are read again first */
+
+   memmove(audio_back+n,audio_back,audio_nback);
+   memcpy(audio_back,buf,n);
+   audio_nback += n;
+}
+
+/*
+   mp2_frame_len: length of the layer 2 frame with the header h,
+                  -1 for free format if the length is not known so far,
+                  0 if h is no header. Only MPEG-1 (ID bit set) is
+                  taken, MPEG-2 LSF frames have half the samples.
+ */
+
+static int mp2_frame_len(unsigned char *h)
+{
+   static int freq_hz[3] = { 44100, 48000, 32000 };
+   int bit_rate;
+
+   if(h[0]!=0xff || (h[1]&0xfe)!=0xfc || (h[2]&0xf0)==0xf0 || (h[2]&0x0c)==0x0c)
+      return 0;
+
+   bit_rate = bitrate_index[1][h[2]>>4];
+   if(bit_rate==0) return free_len ? free_len + ((h[2]>>1)&1) : -1;
+
+   return 144000*bit_rate/freq_hz[(h[2]>>2)&3] + ((h[2]>>1)&1);
+}
+
+/*
+   mp2_resync_ok: after bytes were skipped, a header may be found by chance
+                  in other data (or MPEG-2 LSF frames). The frame with the
+                  header at buf (len bytes) is only taken if the header of
+                  the same stream follows it (or the end of the stream).
+ */
+
+static int mp2_resync_ok(unsigned char *buf, int len)
+{
+   int n, ok;
+
+   n = audio_read(buf+4,len);
+   ok = n<len || (buf[len]==buf[0] && buf[len+1]==buf[1] &&
+                  (buf[len+2]&0xfc)==(buf[2]&0xfc));
+   audio_unread(buf+4,n);
+
+   return ok;
+}
+
+/*
+   mp2_frame: read the next frame of the audio stream to buf,
+              the bytes in front of it which are no frame are skipped
+              (counted in audio_skipped).
+
+   returns the length of the frame,
+           0 at the end (the bytes of an incomplete frame are in audio_rest)
+*/
+
+static int mp2_frame(unsigned char *buf)
+{
+   int n, len;
+
+   audio_skipped = 0;
+
+   n = audio_read(buf,4);
+   while(1)
+   {
+      if(n<4)
+      {
+         audio_rest = n;
+         return 0;
+      }
+      len = mp2_frame_len(buf);
+      if(len>0 && audio_skipped>0 && !mp2_resync_ok(buf,len)) len = 0;
+      if(len) break;
+
+      /* No header here, try the next byte */
+
+      memmove(buf,buf+1,3);
+      n = 3 + audio_read(buf+3,1);
+      audio_skipped++;
+   }
+
+   if(len<0)
+   {
+      /* Free format: the frame ends where the next header starts,
+         which is put back into the stream */
+
+      len = 4;
+      while(len<MAX_AUDIO_FRAME && audio_read(buf+len,1)==1)
+      {
+         len++;
+
+         /* The first 3 bytes of the next header (padding may differ) */
+
+         n = len-3;
+         if(n>4 && buf[n]==buf[0] && buf[n+1]==buf[1] && (buf[n+2]&0xfc)==(buf[2]&0xfc))
+         {
+            audio_unread(buf+n,3);
+            free_len = n - ((buf[2]>>1)&1);
+            return n;
+         }
+      }
+      audio_rest = len;
+      return 0;
+   }
+
+   n = audio_read(buf+4,len-4);
+   if(n<len-4)
+   {
+      audio_rest = 4+n;
+      return 0;
+   }
+
+   return len;
+}
+
+/*
+   mp2_header: check the header of the first audio frame (len bytes at h)
+               and print the properties, the bytes are not consumed
+ */
+
+static void mp2_header(unsigned char *h, int len)
+{
+   unsigned long header;
+   int layer, protection, bit_rate, frequency, padding, mode,
+       mode_extension, copyright, original_copy, emphasis;
+   int numwarn;
+
+   header = 0;
+   if(len>=4) header = ((unsigned long)h[0]<<24) | ((unsigned long)h[1]<<16) |
+                       ((unsigned long)h[2]<<8) | h[3];
+
+   if( (header&0xfff80000) != 0xfff80000)
+   {
+      fprintf(stderr,"Audio input file is not a 11172-3 Audio stream\n");
+      exit(1);
+   }
+
+   layer          = (header>>17) & 3;
+   protection     = (header>>16) & 1;
+   bit_rate       = (header>>12) & 0xf;
+   frequency      = (header>>10) & 3;
+   padding        = (header>> 9) & 1;
+   /* ??? */
+   mode           = (header>> 6) & 3;
+   mode_extension = (header>> 4) & 3;
+   copyright      = (header>> 3) & 1;
+   original_copy  = (header>> 2) & 1;
+   emphasis       =  header      & 3;
+
+   AudioBitRate = bitrate_index[3-layer][bit_rate];
+   AudioFreq    = frequency_index[frequency]*1000 + 0.5;
+
+   /* Free format, the bitrate follows from the length of the frames
+      (known after the first frame is read with mp2_frame()) */
+
+   if(bit_rate==0 && free_len>0 && AudioFreq>0)
+      AudioBitRate = (free_len*AudioFreq + 72000)/144000;
+
+   if(!quiet)
+   {
+      printf("\nAudio input file properties:\n\n");
+      printf("layer:               %3d\n",3-layer+1);
+      printf("protection:          %3d\n",protection);
+      printf("bit_rate:            %3d = %d KB/s\n",bit_rate,AudioBitRate);
+      printf("frequency:           %3d = %2.1f kHz\n",frequency,
+                                      frequency_index[frequency]);
+      printf("mode:                %3d = %s\n",mode,mode_index[mode]);
+      printf("mode_extension:      %3d\n",mode_extension);
+      printf("copyright:           %3d = %s\n",copyright,
+                                      copyright_index[copyright]);
+      printf("original_copy:       %3d = %s\n",original_copy,
+                                      original_index[original_copy]);
+      printf("emphasis:            %3d = %s\n",emphasis,
+                                      emphasis_index[emphasis]);
+      printf("\n");
+   }
+
+   if(layer!=2)
+   {
+      fprintf(stderr,"*** Can not handle layer %d files!\n",3-layer+1);
+      exit(1);
+   }
+   if(AudioBitRate == 0 || AudioFreq == 0)
+   {
+      fprintf(stderr,"*** Audio bitrate or frequency not supported!\n");
+      exit(1);
+   }
+
+   numwarn = 0;
+   if(bit_rate!=11)
+   {
+      fprintf(stderr,"Warning: Bitrate for VCD should be 224 KBit/sec!\n");
+      numwarn++;
+   }
+   if(frequency!=0)
+   {
+      fprintf(stderr,"Warning: Frequency for VCD should be 44.1 kHz!\n");
+      numwarn++;
+   }
+   if(mode!=0)
+   {
+      fprintf(stderr,"Warning: Mode for VCD should be Stereo!\n");
+      numwarn++;
+   }
+
+   if(numwarn)
+   {
+      fprintf(stderr,"*** The audio file does not comply with VCD requirements ***\n");
+      fprintf(stderr,"*** Resulting output might not be readable everywhere ***\n");
+   }
+}
+
+/*
+   video_ticks_per_frame: check the video parameters read by open_m1v(),
+                          returns the MPEG clock ticks per frame
+ */
+
+static int video_ticks_per_frame()
+{
+   if(VideoBitRate==0 || VideoBitRate==0x3ffff)
+   {
+      fprintf(stderr,"Variable Bitrate not supported!\n");
+      exit(1);
+   }
+
+   if (FrameRate==3)
+      return 3600;  /* PAL */
+   else if (FrameRate==4)
+      return 3003;  /* NTSC */
+
+   fprintf(stderr,"Picture rate not supported!\n");
+   exit(1);
+}
+
+/*
+   Preflight: check the input files in parallel before multiplexing,
+   every file is opened like for multiplexing and scanned up to the end
+ */
+
+static char **check_name;
+
+static int check_m1v(char *filename)
+{
+   long frames, iframes, slices, qscale;
+   int tpf, nfields, ret;
+
+   open_m1v(filename);
+   tpf = video_ticks_per_frame();
+   nfields = twofields ? 2 : 1;
+
+   frames = iframes = slices = qscale = 0;
+   while((ret=get_m1v_frame())==0)
+   {
+      slices += MPEG_frame_slices;
+      qscale += MPEG_frame_qscale;
+      if(frames==0 && MPEG_frame_type!=1)
+      {
+         fprintf(stderr,"%s: first frame is not an I frame\n",filename);
+         return 1;
+      }
+      if(MPEG_frame_type==1) iframes++;
+      frames++;
+   }
+
+   /* The multiplexer accepts a missing sequence end code */
+
+   if(ret<0) fprintf(stderr,"%s: Warning: no sequence end code\n",filename);
+
+   printf("%s: MPEG-%d video, %.3f Pictures/sec, %d bits/sec, "
+          "%ld frames (%ld I frames), %.2f secs, %ld slices, "
+          "mean quantizer %.2f\n",filename,mpeg2+1,
+          rates[FrameRate],VideoBitRate*400,frames,iframes,
+          (double)frames*tpf/nfields/90000.,slices,
+          slices ? (double)qscale/slices : 0.);
+   return 0;
+}
+
+static int check_mp2(char *filename)
+{
+   unsigned char frame[MAX_AUDIO_FRAME];
+   long frames, pos;
+   int first, len;
+
+   open_mp2(filename);
+   len = mp2_frame(frame);
+   mp2_header(frame,len);
+
+   /* All frames must have the layer, bitrate and frequency
+      of the first one */
+
+   frames = pos = 0;
+   first = frame[2]&0xfc;
+
+   for(; len>0; len=mp2_frame(frame))
+   {
+      if(audio_skipped)
+      {
+         fprintf(stderr,"%s: no MPEG audio frame at byte %ld\n",filename,pos);
+         return 1;
+      }
+      if((frame[2]&0xfc)!=first)
+      {
+         fprintf(stderr,"%s: bitrate or frequency changes at byte %ld\n",
+                        filename,pos);
+         return 1;
+      }
+
+      pos += len;
+      frames++;
+   }
+
+   if(audio_skipped)
+      fprintf(stderr,"%s: Warning: %ld bytes after last frame\n",
+                     filename,audio_skipped+audio_rest);
+   else if(audio_rest>=4) fprintf(stderr,"%s: Warning: last frame is incomplete\n",filename);
+   else if(audio_rest>0) fprintf(stderr,"%s: Warning: %d bytes after last frame\n",filename,audio_rest);
+
+   printf("%s: MPEG audio layer 2, %d KBit/s, %.1f kHz, %ld frames, %.2f secs\n",
+          filename,AudioBitRate,AudioFreq/1000.,frames,frames*1152./AudioFreq);
+   return 0;
+}
+
+static int check_input(int n)
+{
+   FILE *fd;
+   unsigned char h[4];
+
+   fd = fopen(check_name[n],"r");
+   if(fd==0)
+   {
+      fprintf(stderr,"Error opening %s\n",check_name[n]);
+      perror("open");
+      return 1;
+   }
+   if(fread(h,1,4,fd)!=4) h[0] = h[1] = 0xaa;
+   fclose(fd);
+
+   quiet = 1;
+
+   if(h[0]==0 && h[1]==0 && h[2]==1 && h[3]==0xb3) return check_m1v(check_name[n]);
+   if(h[0]==0xff && (h[1]&0xf0)==0xf0) return check_mp2(check_name[n]);
+
+   fprintf(stderr,"%s: neither a MPEG video nor a MPEG audio stream\n",check_name[n]);
+   return 1;
+}
+
+void mplex_preflight(int argc, char **argv)
+{
+   int *status, nworkers, num, n, failed;
+
+   nworkers = num_cpus();
+   n = 2;
+   if(argc>3 && strcmp(argv[2],"-j")==0)
+   {
+      nworkers = atoi(argv[3]);
+      n = 4;
+   }
+
+   num = argc-n;
+   if(num<=0)
+   {
+      fprintf(stderr,"Usage:\n   %s --preflight [-j workers] file ...\n",argv[0]);
+      exit(1);
+   }
+
+   status = (int *) malloc(num*sizeof(int));
+   if(status==0)
+   {
+      fprintf(stderr,"Out of memory\n");
+      exit(1);
+   }
+
+   check_name = argv+n;
+   failed = run_jobs(num, nworkers, check_input, status);
+
+   for(n=0;n<num;n++)
+      if(status[n]!=0) fprintf(stderr,"%s: FAILED\n",check_name[n]);
+
+   if(failed)
+   {
+      fprintf(stderr,"%d of %d files failed\n",failed,num);
+      exit(1);
+   }
+   printf("All %d files passed\n",num);
+   exit(0);
+}
+
+/* Take a free slot of the video ring for the frame to be read */
+
+static void frame_slot()
+{
+   cur_frame = video_frames + ring_wait_free(&video_ring);
+   cur_frame->pos  = vbuf_put;
+   cur_frame->len  = 0;
+   cur_frame->done = 0;
+   cur_frame->end  = 0;
+}
+
+static void *video_thread(void *arg)
+{
+   int ret;
+
+   /* A frame is put into the ring by frame_begin(), an incomplete
+      frame at the end of the stream is multiplexed as it is */
+
+   do
+   {
+      frame_slot();
+      ret = get_m1v_frame();
+
+      pthread_mutex_lock(&video_ring.lock);
+      cur_frame->done = 1;
+      pthread_cond_broadcast(&video_ring.cond);
+      pthread_mutex_unlock(&video_ring.lock);
+   }
+   while(ret==0);
+
+   /* Tell the multiplexer that there are no more frames */
+
+   if(ret<0) frame_slot();
+   cur_frame->done = 1;
+   cur_frame->end  = 1;
+   ring_put(&video_ring);
+
+   return 0;
+}
+
+/*
+ * The audio packets are filled with whole frames, a frame may continue
+ * in the next packet. The frames come from the audio stream or, for the
+ * simulation of the multiplexing, just their lengths from the index.
+ */
+
+struct audio_frames {
+   unsigned char data[MAX_AUDIO_FRAME];
+   int len;                       /* the current frame, 0 at the end */
+   int pos;                       /* its bytes put into packets */
+   long no;                       /* its number */
+   long long start;               /* its position in the audio data */
+   long *index;                   /* frame lengths, 0 to read the stream */
+   long nindex;
+};
+
+static int next_audio_frame(struct audio_frames *af)
+{
+   int len;
+
+   if(af->index) return af->no<af->nindex ? af->index[af->no] : 0;
+
+   len = mp2_frame(af->data);
+   if(len==0 && af->no>0 && audio_skipped+audio_rest>0)
+      fprintf(stderr,"Audio: %ld bytes after the last frame ignored\n",
+                     audio_skipped+audio_rest);
+   else if(audio_skipped)
+      fprintf(stderr,"Audio: skipped %ld bytes which are no MPEG audio frame\n",
+                     audio_skipped);
+   return len;
+}
+
+static void first_audio_frame(struct audio_frames *af)
+{
+   af->no    = 0;
+   af->start = 0;
+   af->pos   = 0;
+   af->len   = next_audio_frame(af);
+}
+
+static void fill_audio_packet(struct audio_frames *af, struct audio_packet *a)
+{
+   int n;
+
+   a->len = 0;
+   a->nframes = 0;
+   a->first = af->no;
+
+   while(a->len<AUDIO_BYTES && af->len>0)
+   {
+      if(af->pos==0)
+      {
+         /* A frame starts in this packet */
+
+         if(a->nframes==AUDIO_FRAMES_MAX) break;
+         if(a->nframes==0) a->first = af->no;
+         a->end[a->nframes++] = af->start+af->len;
+      }
+
+      n = af->len-af->pos;
+      if(n>AUDIO_BYTES-a->len) n = AUDIO_BYTES-a->len;
+      memcpy(a->data+a->len,af->data+af->pos,n);
+      a->len  += n;
+      af->pos += n;
+
+      if(af->pos==af->len)
+      {
+         af->start += af->len;
+         af->no++;
+         af->pos = 0;
+         af->len = next_audio_frame(af);
+      }
+   }
+
+   /* The frame after is read already, so we know if this is the last */
+
+   a->eof = af->len==0;
+}
+
+static struct audio_frames audio_in;
+
+static void *audio_thread(void *arg)
+{
+   struct audio_packet *a;
+
+   int n;
+
+   open_mp2((char *) arg);
+
+   audio_in.index = 0;
+   first_audio_frame(&audio_in);
+
+   do
+   {
+      n = ring_wait_free(&audio_ring);
+      if(n<0) break;
+      a = audio_packets+n;
+      fill_audio_packet(&audio_in,a);
+      ring_put(&audio_ring);
+   }
+   while(!a->eof);
+
+   if(audioin!=stdin) fclose(audioin);
+
+   return 0;
+}
+
+static void start_thread(pthread_t *thread, void *(*func)(void *), void *arg)
+{
+   if(pthread_create(thread,0,func,arg)!=0)
+   {
+      fprintf(stderr,"Can not create thread\n");
+      exit(1);
+   }
+}
+
+static void buffer_timecode (unsigned long time, unsigned char marker,
+                             unsigned char *buffer)
+{
+   buffer[0] = (marker << 4) | ((time >> 29) & 0x6) | 1;
+   buffer[1] =  (time & 0x3fc00000) >> 22;
+   buffer[2] = ((time & 0x003f8000) >> 14) | 1;
+   buffer[3] =  (time & 0x7f80) >> 7;
+   buffer[4] = ((time & 0x007f) << 1) | 1;
+}
+
+static void make_templates()
+{
+   int audio;
+   unsigned char *p;
+
+   /* PACK header is 0x1ba, the SCR is filled in by make_pack_header() */
+
+   p = pack_template;
+
+   p[0] = 0;
+   p[1] = 0;
+   p[2] = 1;
+   p[3] = 0xba;
+
+   p[ 9] = (0x80 | (MuxRate >>15));
+   p[10] = (0xff & (MuxRate >> 7));
+   p[11] = (0x01 | ((MuxRate & 0x7f)<<1));
+
+   /* SYSTEM header is 0x1bb, one for audio and one for video */
+
+   for(audio=0;audio<2;audio++)
+   {
+      int fixed = 0;
+      int CSPS  = 0;
+      int audio_lock = 0;
+      int video_lock = 0;
+      int audio_bound;
+      int video_bound;
+      int stream_id;
+      int buffer_scale;
+      int buffer_size;
+
+      if(audio)
+      {
+         stream_id    = 0xc0;
+         audio_bound  = 1;
+         video_bound  = 0;
+         buffer_scale = 0;
+         buffer_size  = AUDIO_BUFFER_SIZE/128;
+      }
+      else
+      {
+         stream_id    = 0xe0;
+         audio_bound  = 0;
+         video_bound  = 1;
+         buffer_scale = 1;
+         buffer_size  = VIDEO_BUFFER_SIZE/1024;
+      }
+
+      p = system_template[audio];
+
+      p[0] = 0;
+      p[1] = 0;
+      p[2] = 1;
+      p[3] = 0xbb;
+
+      /* Length is 9 */
+
+      p[4] = 0;
+      p[5] = 9;
+
+      p[6] = (0x80 | (MuxRate >>15));
+      p[7] = (0xff & (MuxRate >> 7));
+      p[8] = (0x01 | ((MuxRate & 0x7f)<<1));
+      p[9] = ((audio_bound << 2)|(fixed << 1)|CSPS);
+      p[10] = ((audio_lock << 7)| (video_lock << 6)|0x20|video_bound);
+      p[11] = 0xff;
+
+      p[12] = stream_id;
+      p[13] = (0xc0 | (buffer_scale << 5) | (buffer_size >> 8));
+      p[14] = (buffer_size & 0xff);
+   }
+
+   memset(pad_fill,0xff,SECTOR_SIZE);
+}
+
+/*
+ * flush_packs: write the collected packs to the output file
+ */
+
+static void write_packs()
+{
+   struct iovec *iov = pack_iov;
+   int n = num_iov;
+   int cnt;
+   long len;
+
+   while(n>0)
+   {
+      cnt = n;
+#ifdef IOV_MAX
+      if(cnt>IOV_MAX) cnt = IOV_MAX;
+#endif
+      len = writev(sysout, iov, cnt);
+      if(len<0)
+      {
+         fprintf(stderr,"Can not write to output file\n");
+         exit(1);
+      }
+
+      /* Skip what is written, writev() may stop in the middle */
+
+      while(n>0 && len>=iov->iov_len)
+      {
+         len -= iov->iov_len;
+         iov++;
+         n--;
+      }
+      if(n>0)
+      {
+         iov->iov_base = (char *)iov->iov_base + len;
+         iov->iov_len -= len;
+      }
+   }
+}
+
+/*
+ * pack_stream_id: the stream id of a pack as read_mpeg_sec() of mkvcdfs
+ *                 gives it: of the packet after the pack header,
+ *                 of the system header if it is for one stream,
+ *                 0 for padding
+ */
+
+static int pack_stream_id(unsigned char *pack)
+{
+   int id;
+
+   id = pack[15];
+   if(id==0xbb) id = pack[24];
+
+   return (id==0xc0 || id==0xe0) ? id : 0;
+}
+
+/*
+ * sink_packs: hand over the pack collected in sink mode
+ *             and hold it back instead of the one before
+ */
+
+static void sink_packs()
+{
+   unsigned char *sec;
+   int i, n;
+
+   if(num_iov==0) return;
+
+   sec = sink_buf[(sink_held==0) ? 1 : 0];
+
+   for(n=i=0;i<num_iov;i++)
+   {
+      memcpy(sec+n,pack_iov[i].iov_base,pack_iov[i].iov_len);
+      n += pack_iov[i].iov_len;
+   }
+
+   if(sink_held>=0) sink(sink_buf[sink_held],pack_stream_id(sink_buf[sink_held]),0);
+
+   sink_held = (sec==sink_buf[0]) ? 0 : 1;
+   sink_len  = npb;
+}
+
+/*
+ * sink_end: hand over the last pack with the ISO 11172 end code
+ */
+
+static void sink_end()
+{
+   static unsigned char end_code[4] = { 0, 0, 1, 0xb9 };
+   unsigned char *sec;
+
+   if(sink_held>=0 && sink_len+4<=SECTOR_SIZE)
+   {
+      sec = sink_buf[sink_held];
+      memcpy(sec+sink_len,end_code,4);
+      sink(sec,pack_stream_id(sec),1);
+      return;
+   }
+
+   if(sink_held>=0) sink(sink_buf[sink_held],pack_stream_id(sink_buf[sink_held]),0);
+
+   sec = sink_buf[(sink_held==0) ? 1 : 0];
+   memset(sec,0,SECTOR_SIZE);
+   memcpy(sec,end_code,4);
+   sink(sec,0,1);
+}
+
+static void flush_packs()
+{
+   if(sink)
+      sink_packs();
+   else
+      write_packs();
+
+   /* A pack which is just being put together (without payload so far)
+      moves to the first place */
+
+   if(num_batch_packs>0 && packet==pack_hdr[num_batch_packs])
+   {
+      memcpy(pack_hdr[0],packet,PACK_HDR_MAX);
+      packet = pack_hdr[0];
+   }
+
+   num_iov = 0;
+   num_batch_packs = 0;
+
+   ring_release(&audio_ring,batch_audio_packets);
+   batch_audio_packets = 0;
+
+   /* The video data written is given back */
+
+   if(vbuf_freed<vbuf_used)
+   {
+      pthread_mutex_lock(&video_ring.lock);
+      vbuf_freed = vbuf_used;
+      pthread_cond_broadcast(&video_ring.cond);
+      pthread_mutex_unlock(&video_ring.lock);
+   }
+}
+
+static void add_iov(void *data, int len)
+{
+   if(len<=0) return;
+
+   pack_iov[num_iov].iov_base = data;
+   pack_iov[num_iov].iov_len  = len;
+   num_iov++;
+}
+
+static void make_pack_header()
+{
+   if(num_batch_packs==PACK_BATCH) flush_packs();
+
+   packet = pack_hdr[num_batch_packs];
+
+   memcpy(packet,pack_template,12);
+   buffer_timecode (system_clock, MARKER_SCR, packet+4 );
+
+   npb = 12;
+   pack_hdr_len = 0;
+   num_payload = 0;
+}
+
+static void make_system_header(int audio)
+{
+   memcpy(packet+npb,system_template[audio],15);
+   npb += 15;
+}
+
+/*
+ * add_payload: add len bytes at data to the current pack,
+ *              they must stay unchanged until flush_packs()
+ */
+
+static void add_payload(unsigned char *data, int len)
+{
+   if(len<=0) return;
+
+   if(num_payload==0) pack_hdr_len = npb;
+
+   payload[num_payload] = data;
+   payload_len[num_payload] = len;
+   num_payload++;
+   npb += len;
+}
+
+/*
+ * write_pack_packet: write out a sector consisting of a pack header
+ *                    and a packet, add length entries for packet,
+ *                    the trailer (at most 4 bytes, e.g. a sequence end code)
+ *                    and a pad packet if wanted
+ */
+
+static void write_pack_packet(int add_pad, unsigned char *trailer, int ntrailer)
+{
+   int i, len;
+   unsigned char *t;
+
+   if(num_payload==0) pack_hdr_len = npb;
+
+   npb += ntrailer;
+
+   /* Safety first */
+
+   if(npb>SECTOR_SIZE || pack_hdr_len>PACK_HDR_MAX)
+   {
+      fprintf(stderr,"Internal error: sector size exceeded!\n");
+      exit(1);
+   }
+
+   len = npb - 18;
+   if(len>0)
+   {
+      packet[16] = len>>8;
+      packet[17] = len&0xff;
+   }
+
+   add_iov(packet, pack_hdr_len);
+   for(i=0;i<num_payload;i++) add_iov(payload[i], payload_len[i]);
+
+   /* The trailer is kept behind the header bytes */
+
+   t = packet+PACK_HDR_MAX;
+   if(ntrailer) memcpy(t,trailer,ntrailer);
+
+   /* Pad packet to neccesary length of SECTOR_SIZE */
+
+   if( add_pad && npb <= SECTOR_SIZE-8)
+   {
+      /* There is space for a PAD packet */
+
+      /* PAD header is 0x1be */
+
+      t[ntrailer++] = 0;
+      t[ntrailer++] = 0;
+      t[ntrailer++] = 1;
+      t[ntrailer++] = 0xbe;
+
+      len = SECTOR_SIZE - npb - 6;
+
+      t[ntrailer++] = (len>>8);
+      t[ntrailer++] = (len&0xff);
+
+      t[ntrailer++] = 0xf; /* No timestamp for this package */
+
+      add_iov(t, ntrailer);
+      add_iov(pad_fill, SECTOR_SIZE - npb - 7);
+      npb = SECTOR_SIZE;
+   }
+   else
+   {
+      add_iov(t, ntrailer);
+      add_iov(zero_fill, SECTOR_SIZE - npb);
+   }
+
+   num_batch_packs++;
+
+   if(sink) flush_packs();
+}
+
+static unsigned char sequence_end_code[4] = { 0, 0, 1, 0xb7 };
+
+/*
+ * add_video: add len bytes of the video data at position pos to the
+ *            current pack, pieces in different segments are added
+ *            one by one
+ */
+
+static void add_video(long long pos, long len)
+{
+   long off, n;
+
+   while(len>0)
+   {
+      off = pos % VSEG_SIZE;
+      n = VSEG_SIZE-off;
+      if(n>len) n = len;
+      add_payload(vseg[(pos/VSEG_SIZE) % VSEG_MAX]+off,n);
+      pos += n;
+      len -= n;
+   }
+
+   vbuf_used = pos;
+}
+
+/*
+ * video_bytes: wait until want bytes of frame f behind the first off bytes
+ *              are read by the video thread or the frame is complete,
+ *              returns the number of bytes there (at most want).
+ *              The packs are written before waiting, so the video
+ *              thread gets all the segments not needed any more.
+ */
+
+static long video_bytes(struct frame *f, long off, long want)
+{
+   long n;
+
+   pthread_mutex_lock(&video_ring.lock);
+   if(f->len-off<want && !f->done)
+   {
+      pthread_mutex_unlock(&video_ring.lock);
+      flush_packs();
+      pthread_mutex_lock(&video_ring.lock);
+      while(f->len-off<want && !f->done) pthread_cond_wait(&video_ring.cond,&video_ring.lock);
+   }
+   n = f->len-off;
+   pthread_mutex_unlock(&video_ring.lock);
+
+   return n<want ? n : want;
+}
+
+/*
+ * next_frame: get the next frame from the video thread.
+ *             The current frame stays until the one after is taken,
+ *             the packs still pointing to older frames are written before.
+ */
+
+static struct frame *next_frame()
+{
+   flush_packs();
+
+   if(frames_held==2)
+   {
+      ring_release(&video_ring,1);
+      frames_held--;
+   }
+   frames_held++;
+
+   return video_frames + ring_get(&video_ring);
+}
+
+/*
+ * The system target decoder (STD) of ISO 11172-1 is simulated to
+ * schedule the packs: the bytes of a packet enter the buffer of their
+ * stream at the SCR of the pack, a picture (audio frame) is taken out
+ * of the buffer at once at its decoding time. A packet is only written
+ * if it fits into the buffer, a picture which is not complete at its
+ * decoding time is a buffer underrun.
+ *
+ * The pictures in the video buffer are kept with the position of their
+ * end in the video data (see add_video()), so the bytes in the buffer
+ * are the bytes put into packs (vbuf_used) minus the bytes decoded.
+ * The same is done with the ends of the audio frames.
+ */
+
+#define STD_PICTURES 256
+#define STD_AUDIO_FRAMES 128
+
+struct std_picture {
+   long dts;                  /* decoding time */
+   long long end;             /* -1 while the picture is written */
+   int late;                  /* underrun reported */
+};
+
+static struct std_picture std_pic[STD_PICTURES];
+static int std_first, std_npic;
+static long long std_vout;    /* video bytes decoded */
+static long long std_ain;     /* audio bytes put into packs */
+static long std_vmax;         /* bytes in the video buffer at most */
+static long std_astart;       /* decoding time of the first audio frame */
+static long long std_aend[STD_AUDIO_FRAMES];
+static long std_aframes;      /* audio frames put into packs (started) */
+static int std_audio_late;
+static long std_underruns;    /* pictures late, audio late counts once */
+
+static void std_reset()
+{
+   std_first = std_npic = 0;
+   std_vout = std_ain = 0;
+   std_vmax = 0;
+   std_aframes = 0;
+   std_audio_late = 0;
+   std_underruns = 0;
+}
+
+/*
+ * std_next_picture: the picture written before ends at pos,
+ *                   the next one is decoded at dts
+ */
+
+static void std_next_picture(long long pos, long dts)
+{
+   struct std_picture *p;
+
+   if(std_npic>0)
+   {
+      p = std_pic + (std_first+std_npic-1)%STD_PICTURES;
+      if(p->end<0) p->end = pos;
+   }
+
+   p = std_pic + (std_first+std_npic)%STD_PICTURES;
+   p->dts  = dts;
+   p->end  = -1;
+   p->late = 0;
+   std_npic++;
+}
+
+/*
+ * std_video_fill: decode the pictures up to time t,
+ *                 returns the bytes in the video buffer then
+ */
+
+static long std_video_fill(long t)
+{
+   struct std_picture *p;
+
+   if(vbuf_used-std_vout>std_vmax) std_vmax = vbuf_used-std_vout;
+
+   while(std_npic>0)
+   {
+      p = std_pic + std_first;
+      if(p->dts>t) break;
+
+      if(p->end<0 || p->end>vbuf_used)
+      {
+         /* What is still missing of the picture is decoded
+            as soon as it comes */
+
+         if(!p->late)
+         {
+            if(!quiet)
+               fprintf(stderr,"***** BUFFER underrun - output may not play correctly *****\n");
+            std_underruns++;
+         }
+         p->late = 1;
+         std_vout = vbuf_used;
+         if(p->end<0) break;
+      }
+
+      if(p->end>std_vout) std_vout = p->end;
+      std_first = (std_first+1)%STD_PICTURES;
+      std_npic--;
+   }
+
+   return vbuf_used>std_vout ? vbuf_used-std_vout : 0;
+}
+
+/*
+ * audio_pts: the decoding (= presentation) time of audio frame n
+ */
+
+static long audio_pts(long n)
+{
+   return std_astart + (long long)n*1152*90000/AudioFreq;
+}
+
+/*
+ * std_audio_packet: the audio packet a is put into a pack
+ */
+
+static void std_audio_packet(struct audio_packet *a)
+{
+   int i;
+
+   for(i=0;i<a->nframes;i++)
+      std_aend[(a->first+i)%STD_AUDIO_FRAMES] = a->end[i];
+   if(a->nframes>0) std_aframes = a->first+a->nframes;
+
+   std_ain += a->len;
+}
+
+/*
+ * std_audio_fill: the bytes in the audio buffer at time t,
+ *                 negative if frames are decoded before they are there
+ */
+
+static long std_audio_fill(long t)
+{
+   long n;
+
+   /* The frames with audio_pts() <= t are decoded */
+
+   if(t<std_astart) return std_ain;
+   n = ((long long)(t-std_astart+1)*AudioFreq-1)/(1152*90000) + 1;
+
+   if(n>std_aframes) return -1;
+   return std_ain - std_aend[(n-1)%STD_AUDIO_FRAMES];
+}
+
+/*
+ * std_schedule: the stream of the packet to write at time t, audio goes
+ *               first, its buffer is just big enough for one packet and
+ *               must never run empty.
+ *               returns 0xc0 (audio), 0xe0 (video) or 0 if none fits
+ */
+
+static int std_schedule(long t, int audio_eof)
+{
+   long afill, vfill;
+
+   afill = std_audio_fill(t);
+   vfill = std_video_fill(t);
+
+   if(afill<0 && !audio_eof && !std_audio_late)
+   {
+      if(!quiet)
+         fprintf(stderr,"***** Audio BUFFER underrun - output may not play correctly *****\n");
+      std_audio_late = 1;
+      std_underruns++;
+   }
+
+   if(!audio_eof && afill+AUDIO_BYTES <= AUDIO_BUFFER_SIZE) return 0xc0;
+   if(vfill+SECTOR_SIZE-18 <= VIDEO_BUFFER_SIZE && std_npic<STD_PICTURES) return 0xe0;
+
+   return 0;
+}
+
+/*
+ * Lowest sector rate (mplex_min_rate()): the streams are indexed before
+ * multiplexing, then the multiplexing is simulated with the sizes of the
+ * frames only, for the sector rates in question.
+ */
+
+static int min_rate = 0;
+
+struct frame_index {
+   long len, no, seq, type;
+};
+
+static struct frame_index *vindex;
+static long vindex_num;
+static struct audio_frames audio_sim;   /* the audio frame lengths */
+
+void mplex_min_rate(int on)
+{
+   min_rate = on;
+}
+
+/*
+ * index_streams: get the sizes of the video and audio frames
+ */
+
+static void index_streams(char *video, char *audio)
+{
+   struct stat st;
+   struct frame_index *f;
+   long max;
+   int n, save_quiet;
+
+   if(stat(video,&st)<0 || !S_ISREG(st.st_mode) ||
+      stat(audio,&st)<0 || !S_ISREG(st.st_mode))
+   {
+      fprintf(stderr,"The streams are read twice for the lowest rate, they must be files\n");
+      exit(1);
+   }
+
+   save_quiet = quiet;
+   quiet = 1;
+   store_video = 0;
+
+   open_m1v(video);
+
+   max = vindex_num = 0;
+   while(1)
+   {
+      n = get_m1v_frame();
+      if(n>0) break;
+
+      if(vindex_num==max)
+      {
+         max = max ? 2*max : 4096;
+         vindex = (struct frame_index *) realloc(vindex,max*sizeof(struct frame_index));
+         if(vindex==0)
+         {
+            fprintf(stderr,"Out of memory\n");
+            exit(1);
+         }
+      }
+      f = vindex + vindex_num++;
+      f->len  = MPEG_frame_len;
+      f->no   = MPEG_frame_no;
+      f->seq  = MPEG_frame_seq;
+      f->type = MPEG_frame_type;
+
+      if(n<0) break; /* an incomplete frame is multiplexed, too */
+   }
+   close(mpegin);
+
+   open_mp2(audio);
+   n = mp2_frame(audio_sim.data);
+   mp2_header(audio_sim.data,n);
+
+   max = audio_sim.nindex = 0;
+   for(; n>0; n=mp2_frame(audio_sim.data))
+   {
+      if(audio_sim.nindex==max)
+      {
+         max = max ? 2*max : 4096;
+         audio_sim.index = (long *) realloc(audio_sim.index,max*sizeof(long));
+         if(audio_sim.index==0)
+         {
+            fprintf(stderr,"Out of memory\n");
+            exit(1);
+         }
+      }
+      audio_sim.index[audio_sim.nindex++] = n;
+   }
+   fclose(audioin);
+
+   quiet = save_quiet;
+   store_video = 1;
+}
+
+/*
+ * simulate_mplex: do what mplex() does at nsecps sectors/sec with the
+ *                 sizes of the frames, returns the number of sectors,
+ *                 the underruns are in std_underruns
+ */
+
+static long simulate_mplex(int nsecps, int tpf, int nfields, long start_time)
+{
+   struct frame_index *f;
+   static struct audio_packet ap;
+   long num_secs, clock, remlen, bytes_out, n, len, dts;
+   long long pos;
+   int tpsect, i, hdr, audio_eof, save_quiet;
+
+   tpsect = 90000/nsecps;
+
+   std_reset();
+   vbuf_used = 0;
+   save_quiet = quiet;
+   quiet = 1;
+
+   /* The 2 sectors with the system headers */
+
+   num_secs = 2;
+   clock = 36000+tpsect;
+
+   i = -1;
+   len = bytes_out = 0;
+   pos = 0;
+   audio_eof = 0;
+   first_audio_frame(&audio_sim);
+
+   while(1)
+   {
+      clock += tpsect;
+
+      switch(std_schedule(clock,audio_eof))
+      {
+         case 0:
+            continue;
+
+         case 0xc0:
+            fill_audio_packet(&audio_sim,&ap);
+            std_audio_packet(&ap);
+            audio_eof = ap.eof;
+            num_secs++;
+            continue;
+      }
+
+      num_secs++;
+
+      remlen = len-bytes_out;
+      if(remlen > SECTOR_SIZE-34)
+      {
+         n = (remlen>SECTOR_SIZE-18) ? SECTOR_SIZE-18 : remlen;
+         vbuf_used += n-1;
+         bytes_out += n-1;
+         continue;
+      }
+
+      /* The next frame starts in this sector */
+
+      pos += len;
+      if(++i==vindex_num) break;
+
+      f = vindex+i;
+      len = f->len;
+
+      if(f->type==1 || f->type==2)
+      {
+         dts = f->no*tpf/nfields+start_time;
+         hdr = 12+6+12;
+      }
+      else
+      {
+         dts = f->seq*tpf/nfields+start_time;
+         hdr = 12+6+5;
+      }
+
+      n = SECTOR_SIZE-hdr-remlen;
+      if(n>len) n = len;
+      vbuf_used += remlen+n;
+      bytes_out = n;
+
+      std_next_picture(pos,dts);
+   }
+
+   /* The sector with the end code */
+
+   quiet = save_quiet;
+   vbuf_used = 0;
+
+   return num_secs+1;
+}
+
+/*
+ * lowest_rate: the lowest number of sectors/sec without buffer underrun,
+ *              starting with the rate nsecps
+ */
+
+static int lowest_rate(int nsecps, int tpf, int nfields, long start_time)
+{
+   long num_secs, best_secs;
+   int lo, hi, mid;
+
+   /* Get a rate without underrun first, 8 times CD speed at most */
+
+   hi = nsecps;
+   best_secs = simulate_mplex(hi,tpf,nfields,start_time);
+   while(std_underruns>0 && hi<600)
+   {
+      hi *= 2;
+      best_secs = simulate_mplex(hi,tpf,nfields,start_time);
+   }
+   if(std_underruns>0)
+   {
+      fprintf(stderr,"Warning: no sector rate without buffer underrun found\n");
+      return nsecps;
+   }
+
+   /* The lowest rate without underrun is in lo+1 ... hi */
+
+   lo = 0;
+   while(hi-lo>1)
+   {
+      mid = (lo+hi)/2;
+      num_secs = simulate_mplex(mid,tpf,nfields,start_time);
+      if(std_underruns>0)
+         lo = mid;
+      else
+      {
+         hi = mid;
+         best_secs = num_secs;
+      }
+   }
+
+   printf("Lowest rate without buffer underrun: %d sectors/sec, "
+          "%ld sectors = %.2f minutes on the disc\n",
+          hi,best_secs,best_secs/(75*60.));
+
+   return hi;
+}
+
+/*
+ * mplex: see mplex.h
+ */
+
+void mplex(char *video, char *audio, int out, pack_sink packs)
+{
+   int num_packs, i, n, remlen;
+   int bytes_out = 0;
+   long video_start_time, audio_start_time;
+   long dts;
+   int audio_eof = 0;
+   int stream;
+   long long rest;
+   struct frame no_frame, *frame;
+   struct audio_packet *ap;
+   int tpf, nfields, nsecps, tpsect;
+   int last_message_time = 0;
+   int use_padding_sectors;
+
+   sysout = out;
+   sink = packs;
+   sink_held = -1;
+
+   num_iov = num_batch_packs = 0;
+   batch_audio_packets = frames_held = 0;
+   ring_reset(&video_ring);
+   ring_reset(&audio_ring);
+
+   store_video = 1;
+   vbuf_put = vbuf_used = vbuf_freed = 0;
+
+   video_start_time = audio_start_time = 72000;
+   std_astart = audio_start_time;
+
+   if(min_rate) index_streams(video,audio);
+
+   /* The audio thread opens and reads the audio stream from now on,
+      while the video headers are read. So an encoder writing both
+      streams to pipes does not block on the one not read */
+
+   start_thread(&audio_tid,audio_thread,audio);
+
+   open_m1v(video);
+
+   tpf = video_ticks_per_frame();
+   nfields = twofields ? 2 : 1;
+   printf("MPEG clock ticks/frame: %d, fields/frame: %d\n",tpf,nfields);
+
+   ap = audio_packets + ring_peek(&audio_ring);
+   mp2_header(ap->data,ap->len);
+
+   if(min_rate)
+   {
+      /* Start the search with the rate calculated below */
+
+      nsecps = (VideoBitRate*400 + AudioBitRate*1000)/18400 + 1;
+      nsecps = lowest_rate(nsecps,tpf,nfields,video_start_time);
+      use_padding_sectors = 0;
+
+      printf("Creating %d sectors/sec without padding\n",nsecps);
+   }
+   else if(VideoBitRate==2880 && AudioBitRate==224)
+   {
+      printf("Input has VCD Bitrates - Creating 75 sectors/sec with padding\n");
+      nsecps = 75;
+      use_padding_sectors = 1;
+   }
+   else
+   {
+      /* Calculate Number of sectors per second assuming
+         2300 used bytes (= 18400 bits) per sector */
+
+      nsecps = (VideoBitRate*400 + AudioBitRate*1000)/18400 + 1;
+
+      /* Round up to a multiple of 5 */
+
+      nsecps = (nsecps+4)/5;
+      nsecps = nsecps*5;
+      use_padding_sectors = 0;
+
+      printf("Creating %d sectors/sec without padding\n",nsecps);
+   }
+
+   /* Mux Rate (a sector has 2352 raw bytes) */
+
+   MuxRate = nsecps*2352/50;
+   printf("Muxrate = %d Bit/s\n",MuxRate*400);
+
+   /* Ticks per sector */
+
+   tpsect = 90000/nsecps;
+
+   system_clock = 36000;
+
+   std_reset();
+
+   make_templates();
+
+   make_pack_header();
+   make_system_header(1);
+   write_pack_packet(1,0,0);
+
+   system_clock += tpsect;
+   make_pack_header();
+   make_system_header(0);
+   write_pack_packet(1,0,0);
+
+   num_packs = 2;
+
+   /* From now on the video and audio streams are read by their threads */
+
+   no_frame.pos  = 0;
+   no_frame.len  = 0;
+   no_frame.done = 1;
+   frame = &no_frame;
+
+   start_thread(&video_tid,video_thread,0);
+
+   while(1)
+   {
+      system_clock += tpsect;
+
+      /* Look what fits into the buffers of the STD now */
+
+      stream = std_schedule(system_clock,audio_eof);
+
+      if(stream==0)
+      {
+         /* Write a padding sector for a constant sector rate,
+            else we just skip one sector (hopefully that works
+            with all players) */
+
+         if(use_padding_sectors)
+         {
+            num_packs++;
+            make_pack_header();
+            write_pack_packet(1,0,0);
+            fprintf(stderr,"Inserted padding sector %d\n",num_packs);
+         }
+         continue;
+      }
+
+      num_packs++;
+      make_pack_header();
+
+      if(stream==0xc0)
+      {
+         /* Audio packet header, the PTS is the one of the first
+            frame starting in the packet */
+
+         ap = audio_packets + ring_get(&audio_ring);
+         batch_audio_packets++;
+
+         packet[npb++] = 0;
+         packet[npb++] = 0;
+         packet[npb++] = 1;
+         packet[npb++] = 0xc0;
+
+         npb += 2; /* For length */
+
+         if(ap->nframes==0)
+         {
+            /* No PTS, stuffing bytes keep the length of the header */
+
+            for(i=0;i<4;i++) packet[npb++] = 0xff;
+         }
+
+         packet[npb++] = 0x40;
+         packet[npb++] = 0x20;
+
+         if(ap->nframes>0)
+         {
+            buffer_timecode(audio_pts(ap->first), MARKER_JUST_PTS, packet+npb);
+            npb+=5;
+         }
+         else
+            packet[npb++] = 0x0f;
+
+         add_payload(ap->data,ap->len);
+         std_audio_packet(ap);
+
+         audio_eof = ap->eof;
+         if(audio_eof) printf("------ Audio EOF at %.2f secs %lld bytes -------\n",
+                              std_aframes*1152./AudioFreq,std_ain);
+
+         write_pack_packet(0,0,0);
+
+         continue;
+      }
+
+      /* video packet  header is 0x1e0 */
+
+      packet[npb++] = 0;
+      packet[npb++] = 0;
+      packet[npb++] = 1;
+      packet[npb++] = 0xe0;
+
+      npb += 2; /* For length */
+
+      /*
+       * The maximum length of a video packet is SECTOR_SIZE-18 bytes.
+       * For starting a new packet we need (at most) 16 additional bytes.
+       * So we can fill the current MPEG data into the buffer if
+       * more than SECTOR_SIZE-34 bytes are present.
+       * The frame may not be read completely so far, we wait only
+       * for the bytes of this pack.
+       */
+
+      remlen = video_bytes(frame,bytes_out,SECTOR_SIZE-18);
+
+      if(remlen > SECTOR_SIZE-34)
+      {
+         n = remlen;
+
+         packet[npb++] = 0xf; /* No timestamp */
+
+         add_video(frame->pos+bytes_out,n-1);
+         bytes_out += n-1;
+
+         write_pack_packet(0,0,0);
+         continue;
+      }
+
+      /*
+       * If we come here, we have to start a new frame in this sector.
+       * The tricky thing is that we don't know yet how big the timecode
+       * will be. Get the next frame to see what we get, the rest of the
+       * current one stays where it is.
+       */
+
+      rest = frame->pos+bytes_out;
+
+      frame = next_frame();
+
+      if(frame->end)
+      {
+         /* The End */
+
+         packet[npb++] = 0xf; /* No timestamp */
+         add_video(rest,remlen);
+
+         /* Add a SEQUENCE_END code for MPEG */
+
+         write_pack_packet(0,sequence_end_code,4);
+
+         /* Add an empty sector starting with ISO11172_END */
+
+         if(sink)
+            sink_end();
+         else
+         {
+            make_pack_header();
+            packet[0] = 0x00;
+            packet[1] = 0x00;
+            packet[2] = 0x01;
+            packet[3] = 0xb9;
+            npb = 4;
+            write_pack_packet(0,0,0);
+         }
+
+         flush_packs();
+
+         std_video_fill(system_clock);
+         printf("Max buffer required: %ld KB\n",(std_vmax+1023)/1024);
+         break;
+      }
+      bytes_out = 0;
+
+      if(frame->type==1 || frame->type==2)
+      {
+         /* I or P frame */
+
+         packet[npb++] = 0x60;
+         packet[npb++] = 0x2e;
+         buffer_timecode(frame->seq*tpf/nfields+video_start_time,
+                         MARKER_PTS,packet+npb);
+         npb+=5;
+         dts = frame->no*tpf/nfields+video_start_time;
+         buffer_timecode(dts,MARKER_DTS,packet+npb);
+         npb+=5;
+      }
+      else
+      {
+         dts = frame->seq*tpf/nfields+video_start_time;
+         buffer_timecode(dts,MARKER_JUST_PTS,packet+npb);
+         npb+=5;
+      }
+
+      /* Inform the waiting user */
+
+      if(frame->seq*tpf/nfields/90000 > last_message_time+10)
+      {
+         last_message_time += 10;
+         printf("%4d seconds done\n",last_message_time);
+      }
+
+      /* Wait for the start of the frame before anything is added,
+         the packs may be written meanwhile */
+
+      n = video_bytes(frame,0,SECTOR_SIZE-npb-remlen);
+
+      add_video(rest,remlen);
+      add_video(frame->pos,n);
+      bytes_out = n;
+
+      /* The picture before is complete now */
+
+      std_next_picture(frame->pos,dts);
+
+      write_pack_packet(0,0,0);
+   }
+
+   /* The audio thread may wait for room in the ring or be done */
+
+   ring_stop(&audio_ring);
+   pthread_join(audio_tid,0);
+   pthread_join(video_tid,0);
+
+   if(mpegin>0) close(mpegin);
+}
@@ -0,0 +1,27 @@
+/* The multiplexer of vcdmplex (mplex.c), also used by mkvcdfs */
+
+/* pack_sink: gets the packs (2324 bytes each) of the system stream one
+              by one. id is the stream id of the packet in it (0xe0 video,
+              0xc0 audio) or 0 (padding, end), like read_mpeg_sec() of
+              mkvcdfs returns it, last is set for the last pack. */
+
+typedef void (*pack_sink)(unsigned char *pack, int id, int last);
+
+/* mplex: multiplex the MPEG video and audio streams ("-" is stdin,
+          may be pipes) to the file descriptor out, or hand the packs
+          to sink instead if it is not 0.
+          The progress is printed to stdout, errors exit(). */
+
+void mplex(char *video, char *audio, int out, pack_sink sink);
+
+/* mplex_min_rate: if on, mplex() multiplexes at the lowest sector rate
+                  without buffer underrun (and without padding sectors),
+                  which is found by simulating the multiplexing first.
+                  The streams are read twice, they must be files. */
+
+void mplex_min_rate(int on);
+
+/* mplex_preflight: vcdmplex --preflight [-j workers] file ...
+                    check the elementary streams, does not return */
+
+void mplex_preflight(int argc, char **argv);
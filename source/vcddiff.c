@@ -0,0 +1,316 @@
+/*
+    vcddiff: compare two VCD images sector by sector
+
+    Usage:
+
+      vcddiff old_image new_image
+
+    Every sector that differs is classified by the parts that differ:
+
+      header      sync pattern and header (bytes 0-15)
+      subheader   bytes 16-23
+      payload     user data (2048 bytes in Form 1, 2324 in Form 2)
+      EDC         error detection code
+      P/Q         P and Q parity (Form 1 only)
+
+    and mapped to the part of the disc it belongs to: volume descriptors,
+    path tables, directories and files of the ISO file system or the
+    MPEG tracks (as found in the old image, see vcdimage.c). If the new
+    image puts something else there, this is given as well.
+    Consecutive sectors of the same part with the same kind of
+    difference are reported as one range.
+
+    The exit code is 0 if the images are identical, 1 otherwise.
+
+
+    Copyright (C) 2026 The VCD-Tools contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcdimage.h"
+
+static struct vcd_image image_a, image_b;
+
+/* Kinds of differences */
+
+#define D_HEADER    1
+#define D_SUBHEADER 2
+#define D_PAYLOAD   4
+#define D_EDC       8
+#define D_PARITY   16
+
+#define NUM_KINDS   5
+
+static char *kind_name[NUM_KINDS] = { "header", "subheader", "payload", "EDC", "P/Q" };
+static long kind_count[NUM_KINDS];
+
+/* The parts of the disc, the first one containing a sector is taken */
+
+struct region {
+   int start, end;   /* sectors start ... end-1 */
+   char *name;
+};
+
+struct layout {
+   struct region *region;
+   int num_regions;
+};
+
+static struct layout layout_a, layout_b;
+
+static void add_region(struct layout *l, int start, int end, char *name)
+{
+   if(start>=end) return;
+
+   l->region = (struct region *)
+      realloc(l->region,(l->num_regions+1)*sizeof(struct region));
+   if(l->region==0)
+   {
+      fprintf(stderr,"Out of memory\n");
+      exit(1);
+   }
+
+   l->region[l->num_regions].start = start;
+   l->region[l->num_regions].end   = end;
+   l->region[l->num_regions].name  = strdup(name);
+   l->num_regions++;
+}
+
+static void add_iso_region(char *path, int extent, int size, int is_dir, void *arg)
+{
+   char name[1100];
+
+   /* The MPEGAV files point to the tracks, these are added already */
+
+   if(strncmp(path,"MPEGAV/",7)==0) return;
+
+   sprintf(name,"%s %s",is_dir ? "directory" : "file",path);
+   add_region((struct layout *) arg, extent, extent+(size+2047)/2048, name);
+}
+
+static void make_layout(struct layout *l, struct vcd_image *img)
+{
+   struct vcd_track track[MAX_VCD_TRACKS];
+   unsigned char *pvd;
+   char name[64];
+   int n, num, size;
+
+   /* MPEG tracks with the pre gap in front, a track lasts
+      until the pre gap of the next one */
+
+   num = vcd_find_tracks(img, track);
+
+   for(n=0;n<num;n++)
+   {
+      sprintf(name,"track %d pre gap",track[n].number);
+      add_region(l, track[n].start-150, track[n].start, name);
+      sprintf(name,"track %d",track[n].number);
+      add_region(l, track[n].start,
+                 (n+1<num) ? track[n+1].start-150 : img->nsecs, name);
+   }
+
+   /* The fixed parts of the ISO file system (see vcdisofs.c) */
+
+   add_region(l, 0, 16, "system area");
+   add_region(l, 16, 17, "primary volume descriptor");
+   add_region(l, 17, 18, "volume descriptor set terminator");
+
+   pvd = vcd_sector(img,16) + 24;
+   if(pvd[0]==1 && memcmp(pvd+1,"CD001",5)==0)
+   {
+      size = pvd[132] | (pvd[133]<<8) | (pvd[134]<<16) | (pvd[135]<<24);
+      size = (size+2047)/2048;
+      n = pvd[140] | (pvd[141]<<8) | (pvd[142]<<16) | (pvd[143]<<24);
+      add_region(l, n, n+size, "path table (L)");
+      n = (pvd[148]<<24) | (pvd[149]<<16) | (pvd[150]<<8) | pvd[151];
+      add_region(l, n, n+size, "path table (M)");
+
+      vcd_iso_walk(img, add_iso_region, (void *) l);
+   }
+
+   /* Everything else */
+
+   add_region(l, 0, (num>0) ? track[0].start-150 : img->nsecs, "track 1 (unused)");
+   add_region(l, 0, img->nsecs, "end of image");
+}
+
+static char *region_name(struct layout *l, int rec)
+{
+   int n;
+
+   for(n=0;n<l->num_regions;n++)
+      if(rec>=l->region[n].start && rec<l->region[n].end) return l->region[n].name;
+
+   return "outside of image";
+}
+
+static int differs(unsigned char *a, unsigned char *b, int from, int to)
+{
+   return memcmp(a+from, b+from, to-from) != 0;
+}
+
+static int classify(unsigned char *a, unsigned char *b)
+{
+   int kind = 0;
+
+   if(differs(a,b, 0,16)) kind |= D_HEADER;
+   if(differs(a,b,16,24)) kind |= D_SUBHEADER;
+
+   /* The form is taken from the old sector */
+
+   if(a[15]==2 && (a[18]&0x20))
+   {
+      /* Mode 2 Form 2 */
+
+      if(differs(a,b,  24,2348)) kind |= D_PAYLOAD;
+      if(differs(a,b,2348,2352)) kind |= D_EDC;
+   }
+   else
+   {
+      /* Mode 2 Form 1 */
+
+      if(differs(a,b,  24,2072)) kind |= D_PAYLOAD;
+      if(differs(a,b,2072,2076)) kind |= D_EDC;
+      if(differs(a,b,2076,2352)) kind |= D_PARITY;
+   }
+
+   return kind;
+}
+
+/* The current range of differing sectors */
+
+static int range_start = -1, range_end, range_kind;
+static char *range_name, *range_name_b;
+static int num_ranges;
+
+static void flush_range()
+{
+   int k, first;
+
+   if(range_start<0) return;
+
+   if(range_end-range_start==1)
+      printf("%8d          ",range_start);
+   else
+      printf("%8d-%-8d ",range_start,range_end-1);
+   printf("%6d  %s",range_end-range_start,range_name);
+   if(strcmp(range_name,range_name_b)!=0) printf(" (new: %s)",range_name_b);
+   printf(":");
+
+   first = 1;
+   for(k=0;k<NUM_KINDS;k++)
+   {
+      if(range_kind & (1<<k))
+      {
+         printf("%s%s",first ? " " : ", ",kind_name[k]);
+         first = 0;
+      }
+   }
+   printf("\n");
+
+   num_ranges++;
+   range_start = -1;
+}
+
+static void add_diff(int rec, int kind)
+{
+   char *name, *name_b;
+
+   name   = region_name(&layout_a, rec);
+   name_b = region_name(&layout_b, rec);
+
+   if(range_start>=0 && rec==range_end && kind==range_kind &&
+      name==range_name && name_b==range_name_b)
+   {
+      range_end++;
+      return;
+   }
+
+   flush_range();
+   range_start = rec;
+   range_end   = rec+1;
+   range_kind  = kind;
+   range_name  = name;
+   range_name_b = name_b;
+}
+
+/* Sectors compared at once, as long as the images are identical */
+
+#define CHUNK 64
+
+main(int argc, char **argv)
+{
+   unsigned char *a, *b;
+   int nsecs, rec, n, k, i, kind;
+   long ndiff;
+
+   if(argc!=3)
+   {
+      fprintf(stderr,"Usage: %s old_image new_image\n",argv[0]);
+      exit(1);
+   }
+
+   vcd_open_image(&image_a, argv[1]);
+   vcd_open_image(&image_b, argv[2]);
+   vcd_sequential(&image_a);
+   vcd_sequential(&image_b);
+
+   make_layout(&layout_a, &image_a);
+   make_layout(&layout_b, &image_b);
+
+   nsecs = (image_a.nsecs<image_b.nsecs) ? image_a.nsecs : image_b.nsecs;
+   ndiff = 0;
+
+   for(rec=0; rec<nsecs; rec+=CHUNK)
+   {
+      n = (nsecs-rec<CHUNK) ? nsecs-rec : CHUNK;
+
+      a = vcd_sector(&image_a, rec);
+      b = vcd_sector(&image_b, rec);
+      if(memcmp(a,b,(long)n*2352)==0) continue;
+
+      for(k=0; k<n; k++, a+=2352, b+=2352)
+      {
+         if(memcmp(a,b,2352)==0) continue;
+
+         kind = classify(a,b);
+         for(i=0;i<NUM_KINDS;i++) if(kind & (1<<i)) kind_count[i]++;
+         ndiff++;
+
+         add_diff(rec+k, kind);
+      }
+   }
+   flush_range();
+
+   /* Summary */
+
+   if(image_a.nsecs!=image_b.nsecs)
+      printf("%s has %d sectors, %s has %d sectors\n",
+             argv[1],image_a.nsecs,argv[2],image_b.nsecs);
+
+   printf("%ld of %d sectors differ in %d ranges",ndiff,nsecs,num_ranges);
+   for(n=0;n<NUM_KINDS;n++)
+      if(kind_count[n]) printf(", %s: %ld",kind_name[n],kind_count[n]);
+   printf("\n");
+
+   vcd_close_image(&image_a);
+   vcd_close_image(&image_b);
+
+   exit((ndiff>0 || image_a.nsecs!=image_b.nsecs) ? 1 : 0);
+}
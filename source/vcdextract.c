@@ -0,0 +1,245 @@
+/*
+    vcdextract: get the MPEG system streams back from a VCD image
+
+    Usage:
+
+      vcdextract [-t toc] [-o prefix] [-e] [-j workers] image
+
+    The tracks are found in the toc file if -t is given, otherwise
+    from the MPEGAV directory (or ENTRIES.VCD) of the ISO file system.
+
+    For every MPEG track the 2324 bytes of data of the Form 2 sectors
+    containing MPEG data are written to prefix02.mpg, prefix03.mpg, ...
+    (default prefix: "track"). The sync pattern, header, subheader and
+    EDC of the sectors as well as the gaps around the MPEG data are
+    left out.
+
+    With -e the packets are split by stream id into the elementary
+    streams prefixNN.m1v (video) and prefixNN.mp2 (audio) instead.
+
+    The tracks are extracted in parallel, one worker process per
+    processor unless -j is given.
+
+
+    Copyright (C) 2026 The VCD-Tools contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcdimage.h"
+#include "jobpool.h"
+
+static struct vcd_image image;
+static struct vcd_track track[MAX_VCD_TRACKS];
+static int num_tracks;
+
+static char *prefix = "track";
+static int elementary = 0;
+
+/* Output files are written in big chunks */
+
+#define OUT_BUFSIZE (1<<20)
+
+static FILE *open_output(int number, char *ext)
+{
+   FILE *fd;
+   char name[1024];
+
+   sprintf(name,"%.1000s%2.2d.%s",prefix,number,ext);
+
+   fd = fopen(name,"wb");
+   if(fd==0)
+   {
+      fprintf(stderr,"Can not open %s\n",name);
+      perror("fopen");
+      exit(1);
+   }
+   setvbuf(fd, 0, _IOFBF, OUT_BUFSIZE);
+
+   return fd;
+}
+
+static void write_data(FILE *fd, unsigned char *data, int len)
+{
+   if(fwrite(data,1,len,fd)!=len)
+   {
+      perror("fwrite");
+      exit(1);
+   }
+}
+
+/*
+   split_pack:
+
+   Write the payload of the video and audio packets in the pack
+   of one sector to the elementary streams
+*/
+
+static void split_pack(unsigned char *pack, FILE *video, FILE *audio)
+{
+   int n, k, id, len;
+   unsigned char *p;
+
+   if(pack[0]!=0 || pack[1]!=0 || pack[2]!=1 || pack[3]!=0xba) return;
+
+   /* MPEG-1 pack header, or MPEG-2 with stuffing */
+
+   if((pack[4]&0xc0)==0x40)
+      n = 14 + (pack[13]&7);
+   else
+      n = 12;
+
+   while(n+6<=2324)
+   {
+      p = pack+n;
+      if(p[0]!=0 || p[1]!=0 || p[2]!=1) break;
+
+      id = p[3];
+      if(id==0xb9) break;
+
+      len = (p[4]<<8) | p[5];
+      if(n+6+len>2324) break;
+      n += 6+len;
+
+      if(id<0xc0 || id>0xef) continue;
+
+      /* Skip the MPEG-1 packet header: stuffing, STD buffer, time stamps */
+
+      p += 6;
+      for(k=0; k<len && p[k]==0xff; k++);
+      if(k<len && (p[k]&0xc0)==0x40) k += 2;
+      if(k<len && (p[k]&0xf0)==0x20)
+         k += 5;
+      else if(k<len && (p[k]&0xf0)==0x30)
+         k += 10;
+      else if(k<len && p[k]==0x0f)
+         k += 1;
+
+      if(k<len) write_data((id>=0xe0) ? video : audio, p+k, len-k);
+   }
+}
+
+static int extract_track(int n)
+{
+   struct vcd_track *t = track+n;
+   unsigned char *sec;
+   FILE *mpeg, *video, *audio;
+   int rec, num;
+
+   mpeg = video = audio = 0;
+
+   if(elementary)
+   {
+      video = open_output(t->number,"m1v");
+      audio = open_output(t->number,"mp2");
+   }
+   else
+      mpeg = open_output(t->number,"mpg");
+
+   num = 0;
+
+   for(rec=t->start; rec<t->start+t->nsecs; rec++)
+   {
+      sec = vcd_sector(&image, rec);
+      if(sec==0) break;
+
+      /* MPEG data is in Mode 2 Form 2 sectors with a channel
+         number != 0, empty sectors have channel 0. The file number
+         is not checked, other tools use 1 for all tracks */
+
+      if(sec[15]!=2 || (sec[18]&0x20)==0 || sec[17]==0) continue;
+
+      if(elementary)
+         split_pack(sec+24, video, audio);
+      else
+         write_data(mpeg, sec+24, 2324);
+      num++;
+   }
+
+   if(elementary)
+   {
+      if(fclose(video) || fclose(audio)) perror("fclose");
+   }
+   else if(fclose(mpeg))
+      perror("fclose");
+
+   printf("Track %d: %d sectors extracted\n",t->number,num);
+
+   return (num>0) ? 0 : 1;
+}
+
+static void usage(char *prog)
+{
+   fprintf(stderr,"Usage: %s [-t toc] [-o prefix] [-e] [-j workers] image\n",prog);
+   exit(1);
+}
+
+main(int argc, char **argv)
+{
+   char *toc = 0;
+   int nworkers = 0;
+   int i, failed;
+
+   for(i=1;i<argc && argv[i][0]=='-';i++)
+   {
+      if(strcmp(argv[i],"-e")==0)
+      {
+         elementary = 1;
+         continue;
+      }
+
+      if(i+1>=argc) usage(argv[0]);
+
+      if(strcmp(argv[i],"-t")==0)
+         toc = argv[++i];
+      else if(strcmp(argv[i],"-o")==0)
+         prefix = argv[++i];
+      else if(strcmp(argv[i],"-j")==0)
+         nworkers = atoi(argv[++i]);
+      else
+         usage(argv[0]);
+   }
+
+   if(i!=argc-1) usage(argv[0]);
+
+   vcd_open_image(&image, argv[i]);
+   vcd_sequential(&image);
+
+   if(toc)
+      num_tracks = vcd_read_toc(toc, track);
+   else
+      num_tracks = vcd_find_tracks(&image, track);
+
+   if(num_tracks==0)
+   {
+      fprintf(stderr,"No MPEG tracks found in %s\n",toc ? toc : argv[i]);
+      exit(1);
+   }
+
+   if(nworkers<=0) nworkers = num_cpus();
+
+   failed = run_jobs(num_tracks, nworkers, extract_track, 0);
+   if(failed)
+   {
+      fprintf(stderr,"%d of %d tracks failed\n",failed,num_tracks);
+      exit(1);
+   }
+
+   vcd_close_image(&image);
+   exit(0);
+}
@@ -0,0 +1,337 @@
+/*
+    vcdimage: read access to raw VCD images written by mkvcdfs
+              (or ripped raw with 2352 bytes per sector)
+
+    The image is mapped into memory, so the tools using it can access
+    any sector directly without copying, and only the sectors accessed
+    are read from disk. If the system can not map the file, it is read
+    into memory instead.
+
+    Copyright (C) 2026 The VCD-Tools contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "vcdimage.h"
+
+#define FROM_BCD(x) ((((x)>>4)&0xf)*10 + ((x)&0xf))
+
+void vcd_open_image(struct vcd_image *img, char *name)
+{
+   struct stat st;
+   long n;
+   int fd, len;
+
+   memset(img,0,sizeof(struct vcd_image));
+   img->name = name;
+
+   fd = open(name, O_RDONLY);
+   if(fd<0 || fstat(fd,&st)<0)
+   {
+      fprintf(stderr,"Can not open image %s\n",name);
+      perror("open");
+      exit(1);
+   }
+
+   img->size  = st.st_size;
+   img->nsecs = img->size/2352;
+
+   if(img->nsecs<=16)
+   {
+      fprintf(stderr,"%s is too small for a VCD image\n",name);
+      exit(1);
+   }
+
+   img->data = (unsigned char *) mmap(0, img->size, PROT_READ, MAP_SHARED, fd, 0);
+
+   if(img->data != (unsigned char *) MAP_FAILED)
+      img->mapped = 1;
+   else
+   {
+      img->data = (unsigned char *) malloc(img->size);
+      if(img->data==0)
+      {
+         fprintf(stderr,"Out of memory reading %s\n",name);
+         exit(1);
+      }
+      for(n=0; n<img->size; n+=len)
+      {
+         len = read(fd, img->data+n, (img->size-n>(1<<20)) ? (1<<20) : img->size-n);
+         if(len<=0)
+         {
+            fprintf(stderr,"Error reading %s\n",name);
+            perror("read");
+            exit(1);
+         }
+      }
+   }
+
+   close(fd);
+}
+
+void vcd_sequential(struct vcd_image *img)
+{
+#ifdef MADV_SEQUENTIAL
+   if(img->mapped) madvise((void *) img->data, img->size, MADV_SEQUENTIAL);
+#endif
+}
+
+void vcd_close_image(struct vcd_image *img)
+{
+   if(img->mapped)
+      munmap((void *) img->data, img->size);
+   else
+      free(img->data);
+   img->data = 0;
+}
+
+unsigned char *vcd_sector(struct vcd_image *img, int rec)
+{
+   if(rec<0 || rec>=img->nsecs) return 0;
+   return img->data + (long)rec*2352;
+}
+
+/* Little endian half of the both-byte order numbers of ISO 9660 */
+
+static int get_731(unsigned char *p)
+{
+   return p[0] | (p[1]<<8) | (p[2]<<16) | (p[3]<<24);
+}
+
+static int dir_lookup(struct vcd_image *img, int dir_extent, int dir_size,
+                      char *name, int namelen, int *extent, int *size)
+{
+   /* Search one directory for name (without version) */
+
+   unsigned char *sec, *rec;
+   int blk, n, len;
+
+   for(blk=0; blk<(dir_size+2047)/2048; blk++)
+   {
+      sec = vcd_sector(img, dir_extent+blk);
+      if(sec==0) return -1;
+
+      /* Directory records never cross a block boundary,
+         the rest of a block is filled with zeros */
+
+      for(n=0; n<2048-33; n+=len)
+      {
+         rec = sec + 24 + n;
+         len = rec[0];
+         if(len==0 || n+len>2048) break;
+
+         if(rec[32]>=namelen && memcmp(rec+33,name,namelen)==0 &&
+            (rec[32]==namelen || rec[33+namelen]==';'))
+         {
+            *extent = get_731(rec+2);
+            *size   = get_731(rec+10);
+            return 0;
+         }
+      }
+   }
+
+   return -1;
+}
+
+int vcd_iso_lookup(struct vcd_image *img, char *path, int *extent, int *size)
+{
+   unsigned char *pvd;
+   char *p;
+
+   /* Start with the root directory record in the volume descriptor */
+
+   pvd = vcd_sector(img, 16) + 24;
+   if(pvd[0]!=1 || memcmp(pvd+1,"CD001",5)!=0) return -1;
+
+   *extent = get_731(pvd+156+2);
+   *size   = get_731(pvd+156+10);
+
+   while(*path)
+   {
+      for(p=path; *p && *p!='/'; p++);
+      if(dir_lookup(img, *extent, *size, path, p-path, extent, size)) return -1;
+      path = *p ? p+1 : p;
+   }
+
+   return 0;
+}
+
+/* Directories nested deeper are not followed */
+
+#define MAX_WALK_DEPTH 8
+
+static void walk_dir(struct vcd_image *img, char *path, int dir_extent, int dir_size,
+                     int depth,
+                     void (*fn)(char *path, int extent, int size, int is_dir, void *arg),
+                     void *arg)
+{
+   unsigned char *sec, *rec;
+   char name[1024];
+   int blk, n, len, extent, size;
+
+   for(blk=0; blk<(dir_size+2047)/2048; blk++)
+   {
+      sec = vcd_sector(img, dir_extent+blk);
+      if(sec==0) return;
+
+      for(n=0; n<2048-33; n+=len)
+      {
+         rec = sec + 24 + n;
+         len = rec[0];
+         if(len==0 || n+len>2048) break;
+
+         /* skip . and .. */
+
+         if(rec[32]==1 && rec[33]<=1) continue;
+
+         extent = get_731(rec+2);
+         size   = get_731(rec+10);
+         sprintf(name,"%.900s%.*s",path,rec[32],rec+33);
+
+         if(rec[25]&2)
+         {
+            fn(name, extent, size, 1, arg);
+            if(depth<MAX_WALK_DEPTH && extent!=dir_extent)
+            {
+               strcat(name,"/");
+               walk_dir(img, name, extent, size, depth+1, fn, arg);
+            }
+         }
+         else
+            fn(name, extent, size, 0, arg);
+      }
+   }
+}
+
+void vcd_iso_walk(struct vcd_image *img,
+                  void (*fn)(char *path, int extent, int size, int is_dir, void *arg),
+                  void *arg)
+{
+   unsigned char *pvd;
+   int extent, size;
+
+   pvd = vcd_sector(img, 16) + 24;
+   if(pvd[0]!=1 || memcmp(pvd+1,"CD001",5)!=0) return;
+
+   extent = get_731(pvd+156+2);
+   size   = get_731(pvd+156+10);
+
+   fn("/", extent, size, 1, arg);
+   walk_dir(img, "", extent, size, 1, fn, arg);
+}
+
+int vcd_find_tracks(struct vcd_image *img, struct vcd_track *track)
+{
+   unsigned char *ent;
+   char name[32];
+   int n, i, num, extent, size, t, rec;
+
+   /* The MPEGAV directory points to every track */
+
+   for(n=0;n<MAX_VCD_TRACKS;n++)
+   {
+      sprintf(name,"MPEGAV/AVSEQ%2.2d.DAT",n+1);
+      if(vcd_iso_lookup(img, name, &extent, &size)) break;
+
+      track[n].number = n+2;
+      track[n].start  = extent;
+      track[n].nsecs  = size/2048;
+   }
+   if(n>0) return n;
+
+   /* Otherwise use the first entry point of every track in ENTRIES.VCD,
+      a track ends with the pre gap of the next one */
+
+   ent = vcd_sector(img, 151);
+   if(ent==0 || memcmp(ent+24,"ENTRYVCD",8)!=0) return 0;
+   ent += 24;
+
+   num = (ent[10]<<8) | ent[11];
+   if(num>500) num = 500;
+
+   for(i=0;i<num && n<MAX_VCD_TRACKS;i++)
+   {
+      t = FROM_BCD(ent[12+4*i]);
+      if(n>0 && track[n-1].number==t) continue;
+
+      rec = (FROM_BCD(ent[13+4*i])*60 + FROM_BCD(ent[14+4*i]))*75
+          + FROM_BCD(ent[15+4*i]) - 150;
+
+      if(n>0) track[n-1].nsecs = rec - 150 - track[n-1].start;
+      track[n].number = t;
+      track[n].start  = rec;
+      n++;
+   }
+   if(n>0) track[n-1].nsecs = img->nsecs - track[n-1].start;
+
+   return n;
+}
+
+int vcd_read_toc(char *filename, struct vcd_track *track)
+{
+   FILE *fd;
+   char line[1024], *p;
+   long offset;
+   int n, m, s, f, tracks;
+
+   fd = fopen(filename,"r");
+   if(fd==0)
+   {
+      fprintf(stderr,"Can not open toc file %s\n",filename);
+      perror("fopen");
+      exit(1);
+   }
+
+   /* Every track but the first (ISO 9660) is given as
+      DATAFILE "image" #offset mm:ss:ff */
+
+   tracks = 0;
+   n = 0;
+
+   while(fgets(line,sizeof(line),fd))
+   {
+      if(strncmp(line,"TRACK",5)==0) tracks++;
+      if(strncmp(line,"DATAFILE",8)!=0 || tracks<2) continue;
+
+      p = strchr(line,'#');
+      if(p==0 || sscanf(p+1,"%ld %d:%d:%d",&offset,&m,&s,&f)!=4)
+      {
+         fprintf(stderr,"%s: can not read track %d\n",filename,tracks);
+         exit(1);
+      }
+      if(n>=MAX_VCD_TRACKS)
+      {
+         fprintf(stderr,"%s: too many tracks\n",filename);
+         exit(1);
+      }
+
+      track[n].number = tracks;
+      track[n].start  = offset/2352;
+      track[n].nsecs  = (m*60+s)*75+f;
+      n++;
+   }
+
+   fclose(fd);
+
+   return n;
+}
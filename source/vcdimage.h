@@ -0,0 +1,62 @@
+/* Read access to raw VCD images (2352 byte sectors) as written by mkvcdfs */
+
+/* The image, mapped into memory as a whole */
+
+struct vcd_image {
+   char *name;
+   unsigned char *data;
+   long size;           /* in bytes */
+   int  nsecs;          /* number of complete sectors */
+   int  mapped;         /* data is mapped, not read */
+};
+
+/* A MPEG track of the image */
+
+#define MAX_VCD_TRACKS 98
+
+struct vcd_track {
+   int number;          /* CD track number, the first MPEG track is 2 */
+   int start;           /* first sector after the pre gap */
+   int nsecs;           /* number of sectors */
+};
+
+/* open/close an image, vcd_open_image exits on errors */
+
+void vcd_open_image(struct vcd_image *img, char *name);
+void vcd_close_image(struct vcd_image *img);
+
+/* vcd_sequential: the image will be read from start to end */
+
+void vcd_sequential(struct vcd_image *img);
+
+/* vcd_sector: pointer to the 2352 bytes of sector rec,
+               0 if rec is outside the image */
+
+unsigned char *vcd_sector(struct vcd_image *img, int rec);
+
+/* vcd_iso_lookup: find a file or directory by its path in the
+                   ISO 9660 file system, for example "MPEGAV/AVSEQ01.DAT".
+                   The version number (";1") need not be given.
+
+   returns 0 and sets extent and size (in bytes) if found, -1 otherwise */
+
+int vcd_iso_lookup(struct vcd_image *img, char *path, int *extent, int *size);
+
+/* vcd_iso_walk: call fn for every directory and file of the ISO 9660
+                 file system, starting with the root directory ("/").
+                 path is the full path, for example "MPEGAV/AVSEQ01.DAT;1" */
+
+void vcd_iso_walk(struct vcd_image *img,
+                  void (*fn)(char *path, int extent, int size, int is_dir, void *arg),
+                  void *arg);
+
+/* vcd_find_tracks: get the MPEG tracks from the MPEGAV directory,
+                    if there is none from ENTRIES.VCD
+
+   vcd_read_toc: get the MPEG tracks from a toc file written by mkvcdfs,
+                 exits on errors
+
+   both return the number of tracks found */
+
+int vcd_find_tracks(struct vcd_image *img, struct vcd_track *track);
+int vcd_read_toc(char *filename, struct vcd_track *track);
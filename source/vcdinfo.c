@@ -0,0 +1,191 @@
+/*
+    vcdinfo: print the metadata of VCD images as JSON
+
+    Usage:
+
+      vcdinfo image ...
+
+    For every image one line of JSON is printed with the volume
+    descriptor (sector 16), INFO.VCD (sector 150), ENTRIES.VCD
+    (sector 151) and the tracks of the MPEGAV directory.
+    Only these sectors and the directories leading to MPEGAV are
+    read, not the whole image.
+
+    Images that can not be read are reported with "error",
+    the exit code is 1 if there were any.
+
+
+    Copyright (C) 2026 The VCD-Tools contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "vcdimage.h"
+
+#define FROM_BCD(x) ((((x)>>4)&0xf)*10 + ((x)&0xf))
+
+static void json_string(unsigned char *str, int len)
+{
+   /* Print str (at most len chars, without trailing blanks) for JSON */
+
+   int n;
+
+   while(len>0 && (str[len-1]==' ' || str[len-1]==0)) len--;
+
+   putchar('"');
+   for(n=0;n<len && str[n];n++)
+   {
+      if(str[n]=='"' || str[n]=='\\')
+         putchar('\\');
+      if(str[n]<0x20 || str[n]>=0x7f)
+         printf("\\u%4.4x",str[n]);
+      else
+         putchar(str[n]);
+   }
+   putchar('"');
+}
+
+static void print_error(char *name, char *error)
+{
+   printf("{\"image\": ");
+   json_string((unsigned char *)name, strlen(name));
+   printf(", \"error\": \"%s\"}\n",error);
+}
+
+static void print_info(struct vcd_image *img)
+{
+   struct vcd_track track[MAX_VCD_TRACKS];
+   unsigned char *pvd, *info, *ent, *d;
+   int n, num, rec;
+
+   pvd = vcd_sector(img,16) + 24;
+
+   printf("{\"image\": ");
+   json_string((unsigned char *)img->name, strlen(img->name));
+   printf(", \"sectors\": %d",img->nsecs);
+
+   /* Primary volume descriptor */
+
+   printf(", \"system_id\": ");
+   json_string(pvd+8,32);
+   printf(", \"volume_id\": ");
+   json_string(pvd+40,32);
+   printf(", \"volume_space\": %d",pvd[80] | (pvd[81]<<8) | (pvd[82]<<16) | (pvd[83]<<24));
+   printf(", \"application_id\": ");
+   json_string(pvd+574,128);
+
+   d = pvd+813;
+   printf(", \"created\": \"%.4s-%.2s-%.2sT%.2s:%.2s:%.2s\"",d,d+4,d+6,d+8,d+10,d+12);
+
+   /* INFO.VCD */
+
+   info = vcd_sector(img,150);
+   if(info && memcmp(info+24,"VIDEO_CD",8)==0)
+   {
+      info += 24;
+      printf(", \"info\": {\"version\": %d, \"profile\": %d, \"album_id\": ",
+             info[8],info[9]);
+      json_string(info+10,16);
+      printf(", \"volume_count\": %d, \"volume_number\": %d}",
+             (info[26]<<8) | info[27], (info[28]<<8) | info[29]);
+   }
+
+   /* MPEG tracks */
+
+   num = vcd_find_tracks(img, track);
+
+   printf(", \"tracks\": [");
+   for(n=0;n<num;n++)
+      printf("%s{\"track\": %d, \"sector\": %d, \"sectors\": %d}",
+             n ? ", " : "", track[n].number, track[n].start, track[n].nsecs);
+   printf("]");
+
+   /* ENTRIES.VCD */
+
+   ent = vcd_sector(img,151);
+   if(ent && memcmp(ent+24,"ENTRYVCD",8)==0)
+   {
+      ent += 24;
+      num = (ent[10]<<8) | ent[11];
+      if(num>500) num = 500;
+
+      printf(", \"entries\": [");
+      for(n=0;n<num;n++)
+      {
+         d = ent+12+4*n;
+         rec = (FROM_BCD(d[1])*60 + FROM_BCD(d[2]))*75 + FROM_BCD(d[3]) - 150;
+         printf("%s{\"track\": %d, \"msf\": \"%2.2d:%2.2d:%2.2d\", \"sector\": %d}",
+                n ? ", " : "", FROM_BCD(d[0]),
+                FROM_BCD(d[1]), FROM_BCD(d[2]), FROM_BCD(d[3]), rec);
+      }
+      printf("]");
+   }
+
+   printf("}\n");
+}
+
+main(int argc, char **argv)
+{
+   struct vcd_image img;
+   struct stat st;
+   unsigned char *pvd;
+   int i, errors;
+
+   if(argc<2)
+   {
+      fprintf(stderr,"Usage: %s image ...\n",argv[0]);
+      exit(1);
+   }
+
+   errors = 0;
+
+   for(i=1;i<argc;i++)
+   {
+      /* vcd_open_image() exits on errors, so check before */
+
+      if(stat(argv[i],&st)<0)
+      {
+         print_error(argv[i],"can not open image");
+         errors++;
+         continue;
+      }
+      if(st.st_size<17*2352)
+      {
+         print_error(argv[i],"too small for a VCD image");
+         errors++;
+         continue;
+      }
+
+      vcd_open_image(&img, argv[i]);
+
+      pvd = vcd_sector(&img,16) + 24;
+      if(pvd[0]!=1 || memcmp(pvd+1,"CD001",5)!=0)
+      {
+         print_error(argv[i],"no ISO 9660 volume descriptor");
+         errors++;
+      }
+      else
+         print_info(&img);
+
+      vcd_close_image(&img);
+   }
+
+   exit(errors ? 1 : 0);
+}
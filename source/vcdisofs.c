@@ -1,6 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "defaults.h"
+#include "mkvcdfs.h"
 
 /*
  * Make a (simple) ISO 9660 filesystem for a Video CD
@@ -14,41 +21,66 @@
  *     0-15       empty
  *     16         Primary Volume descriptor
  *     17         End Volume descriptor
- *     18         Path table (Intel Byte order) (must fit in 1 Sector)
- *     19         Path table (Motorola Byte order) (must fit in 1 Sector)
- *     20         Root directory
- *     21  ...    Other directories
- *     150 ...    Files in directory VCD
- *     210 ...    Other files
+ *     18  ...    Path table (Intel Byte order)
+ *         ...    Path table (Motorola Byte order)
+ *         ...    Root directory, other directories
+ *     150        INFO.VCD
+ *     151        ENTRIES.VCD
+ *     210 ...    Other files (CDI_VCD.APP, files added by the user),
+ *                path tables and directories which do not fit
+ *                below block 150
+ *
+ * The file system is first built as a directory tree in memory
+ * (vcd_iso_layout), this gives the size of the first track before
+ * any MPEG track is written. mk_vcd_iso_fs then fills in the
+ * positions of the MPEG tracks and writes the first track.
  */
 
+#define FIRST_DIR_EXTENT   18
+#define VCD_INFO_EXTENT    150 /* INFO.VCD must be at sector 150 */
+#define VCD_ENTRIES_EXTENT 151 /* ENTRIES.VCD must be at sector 151 */
+#define START_FILE_EXTENT  210 /* for files not in directory VCD */
+
+/* A directory or file of the ISO file system */
+
+struct iso_node {
+   char name[40];     /* ISO 9660 identifier, ";1" included for files */
+   int  namelen;
+   int  flags;        /* 2 for directories, 0 for files */
+   int  xa;           /* file number for the XA entry, 0 for none */
+   int  extent;       /* first block, -1 if not yet allocated */
+   int  size;         /* in bytes */
+   int  blocks;       /* number of blocks written in the first track */
+   char *data;        /* contents of these blocks, 0 for zeros */
+   char *path;        /* or the file to copy them from */
+   int  number;       /* number of a directory in the path tables */
+   struct iso_node *parent, *child, *next;
+};
 
-/* Path table stuff. Note that this is simplified and only valid
-   if there are no subdirectories below the directories in the
-   root directory and if the path tables fit into 1 sector */
-
-#define PATH_TABLE_L_EXTENT 18
-#define PATH_TABLE_M_EXTENT 19
+static struct iso_node *root;
+static struct iso_node *entries_node;
+static struct iso_node *scandata_node;
+static struct iso_node **avseq_node;  /* the MPEG files AVSEQnn.DAT */
 
-#define ISO_DIR_SIZE 2048
+/* All directories in the order of the path tables */
 
-static char path_table_l[2048];
-static char path_table_m[2048];
-static int  path_table_size;
+static struct iso_node **dirs;
+static int num_dirs;
 
-#define ROOT_DIR_EXTENT   20
-#define START_FILE_EXTENT 210 /* for files not in directory VCD */
+static struct iso_node path_table_l, path_table_m;
+static int path_table_size;
 
-static int root_dir_len;
-static char root_dir[ISO_DIR_SIZE];
-static int cur_dir_extent;
-static int cur_file_extent;
+static int iso_blocks;
 
 static char zero2048[2048] = { 0, };
 static char buff2048[2048];
 
 #define LEN2BLOCKS(x) ( ((x)+2047)>>11 )
 
+/* Files added by the user are copied in chunks of this many blocks */
+
+#define COPY_BLOCKS 64
+
 /* Various files on the VCD */
 
 static char entries_file[2048];
@@ -114,51 +146,6 @@ static void set_str( char *pnt, char *src, unsigned int len)
 }
 
 
-void make_path_tables()
-{
-   int i, j, len, extent;
-   unsigned char *root_dir_entry;
-
-   memset(path_table_l, 0, sizeof(path_table_l));
-   memset(path_table_m, 0, sizeof(path_table_m));
-
-   path_table_size = 0;
-
-   for(root_dir_entry = root_dir;
-       root_dir_entry[0]>0;
-       root_dir_entry += root_dir_entry[0] )
-   {
-      /* Skip the .. entry in the root directory */
-
-      if (root_dir_entry[33]==1) continue;
-
-      len = root_dir_entry[32];
-      path_table_l[path_table_size] = len;
-      path_table_m[path_table_size] = len;
-      path_table_size += 2;
-
-      extent =  root_dir_entry[2]      +
-               (root_dir_entry[3]<< 8) +
-               (root_dir_entry[4]<<16) +
-               (root_dir_entry[5]<<24);
-      set_731(path_table_l + path_table_size, extent);
-      set_732(path_table_m + path_table_size, extent);
-      path_table_size += 4;
-
-      set_721(path_table_l + path_table_size, 1);
-      set_722(path_table_m + path_table_size, 1);
-      path_table_size += 2;
-
-      for(j=0; j<len; j++)
-      {
-         path_table_l[path_table_size] = root_dir_entry[33+j];
-         path_table_m[path_table_size] = root_dir_entry[33+j];
-         path_table_size++;
-      }
-      if(path_table_size & 1) path_table_size++;
-   }
-}
-
 /* From mkisofs: */
 
 #define ISODCL(from, to) (to - from + 1)
@@ -214,8 +201,100 @@ static struct iso_directory_record {
 } idr;
 
 
-static void add_dirent(char *dir, int *dirlen, int dirsize,
-           char *name, int namelen, int extent, int size, int flags, int xa)
+/* All memory of the file system of a disc is allocated with iso_alloc
+   and kept in one list, it is freed when the next disc is laid out */
+
+#define ISO_MEM_HDR 16        /* list pointer, keeps the alignment */
+
+static char *iso_mem;
+
+static void *iso_alloc(int size)
+{
+   char *p;
+
+   p = (char *) calloc(1,ISO_MEM_HDR+size);
+   if(p==0)
+   {
+      fprintf(stderr,"Fatal Error: out of memory for ISO file system\n");
+      exit(1);
+   }
+   *(char **)p = iso_mem;
+   iso_mem = p;
+   return p+ISO_MEM_HDR;
+}
+
+static void iso_free()
+{
+   char *p;
+
+   while(iso_mem)
+   {
+      p = iso_mem;
+      iso_mem = *(char **)p;
+      free(p);
+   }
+}
+
+static void sort_key(char *name, int namelen, char *key)
+{
+   /* ISO 9660 sorts by name and extension separately,
+      both padded with blanks */
+
+   int i, j;
+
+   memset(key,' ',64);
+   for(i=0,j=0; i<namelen && name[i]!='.' && name[i]!=';'; i++)
+      key[j++] = name[i];
+   if(i<namelen && name[i]=='.') i++;
+   for(j=32; i<namelen && name[i]!=';'; i++)
+      key[j++] = name[i];
+}
+
+static struct iso_node *new_node(struct iso_node *parent,
+                                 char *name, int flags)
+{
+   struct iso_node *node, **pp;
+   char key1[64], key2[64];
+
+   node = (struct iso_node *) iso_alloc(sizeof(struct iso_node));
+
+   node->namelen = strlen(name);
+   if(node->namelen>=sizeof(node->name))
+   {
+      fprintf(stderr,"Fatal Error: ISO name %s too long\n",name);
+      exit(1);
+   }
+   strcpy(node->name,name);
+   node->flags  = flags;
+   node->extent = -1;
+   node->parent = parent;
+
+   if(parent==0) return node;
+
+   /* Insert into the sorted list of entries of the parent */
+
+   sort_key(node->name, node->namelen, key1);
+   for(pp = &parent->child; *pp; pp = &(*pp)->next)
+   {
+      sort_key((*pp)->name, (*pp)->namelen, key2);
+      if(memcmp(key1,key2,64)<0) break;
+
+      if(memcmp(key1,key2,64)==0)
+      {
+         /* Directories of the same name are merged */
+
+         if(flags==2 && (*pp)->flags==2) return *pp;
+         fprintf(stderr,"Fatal Error: duplicate ISO name %s\n",name);
+         exit(1);
+      }
+   }
+   node->next = *pp;
+   *pp = node;
+
+   return node;
+}
+
+static int dirent_len(int namelen, int xa)
 {
    int reclen;
 
@@ -224,6 +303,26 @@ static void add_dirent(char *dir, int *dirlen, int dirsize,
 
    if(xa>0) reclen += 14; /* RJ: I don't know for what - see below */
 
+   return reclen;
+}
+
+static int dirent_pos(int dirlen, int reclen)
+{
+   /* A directory record must not cross a block boundary */
+
+   if( (dirlen&2047) + reclen > 2048 ) dirlen = (dirlen+2047) & ~2047;
+
+   return dirlen;
+}
+
+static void add_dirent(char *dir, int *dirlen, int dirsize,
+           char *name, int namelen, int extent, int size, int flags, int xa)
+{
+   int reclen;
+
+   reclen = dirent_len(namelen, xa);
+   *dirlen = dirent_pos(*dirlen, reclen);
+
    if( (*dirlen) + reclen > dirsize )
    {
       fprintf(stderr,"Fatal Error: add_dirent - max dirsize exceeded\n");
@@ -277,7 +376,127 @@ static void add_dirent(char *dir, int *dirlen, int dirsize,
 
 }
 
-static void make_ipd()
+static int dir_size(struct iso_node *dir)
+{
+   /* Size of a directory: ".", ".." and one record per entry */
+
+   struct iso_node *node;
+   int len;
+
+   len = 2*dirent_len(1, 0);
+
+   for(node=dir->child; node; node=node->next)
+      len = dirent_pos(len, dirent_len(node->namelen, node->xa))
+            + dirent_len(node->namelen, node->xa);
+
+   return LEN2BLOCKS(len)*2048;
+}
+
+static void make_dir(struct iso_node *dir)
+{
+   struct iso_node *node, *parent;
+   int dirlen;
+   char name[1];
+
+   dir->data = (char *) iso_alloc(dir->size);
+   dirlen = 0;
+
+   /* add . and .. entries */
+
+   parent = dir->parent ? dir->parent : dir;
+
+   name[0] = 0;
+   add_dirent(dir->data, &dirlen, dir->size, name, 1,
+              dir->extent, dir->size, 2, 0);
+
+   name[0] = 1;
+   add_dirent(dir->data, &dirlen, dir->size, name, 1,
+              parent->extent, parent->size, 2, 0);
+
+   /* add the entries, they are already sorted */
+
+   for(node=dir->child; node; node=node->next)
+      add_dirent(dir->data, &dirlen, dir->size, node->name, node->namelen,
+                 node->extent, node->size, node->flags, node->xa);
+}
+
+static void collect_dirs()
+{
+   /* List all directories level by level, within a level sorted by
+      parent and name. This is the order of the path tables */
+
+   struct iso_node *node, **more;
+   int i, max;
+
+   max = 16;
+   dirs = (struct iso_node **) iso_alloc(max*sizeof(struct iso_node *));
+   dirs[0] = root;
+   num_dirs = 1;
+
+   for(i=0;i<num_dirs;i++)
+   {
+      dirs[i]->number = i+1;
+
+      for(node=dirs[i]->child; node; node=node->next)
+      {
+         if(node->flags!=2) continue;
+
+         if(num_dirs>=max)
+         {
+            more = (struct iso_node **)
+                   iso_alloc(2*max*sizeof(struct iso_node *));
+            memcpy(more,dirs,max*sizeof(struct iso_node *));
+            dirs = more;
+            max *= 2;
+         }
+         dirs[num_dirs++] = node;
+      }
+   }
+}
+
+static void make_path_tables()
+{
+   int i, j, len;
+   struct iso_node *dir;
+   char *pt_l, *pt_m;
+
+   pt_l = path_table_l.data;
+   pt_m = path_table_m.data;
+
+   memset(pt_l, 0, path_table_l.blocks*2048);
+   memset(pt_m, 0, path_table_m.blocks*2048);
+
+   path_table_size = 0;
+
+   for(i=0;i<num_dirs;i++)
+   {
+      dir = dirs[i];
+
+      len = dir->namelen;
+      pt_l[path_table_size] = len;
+      pt_m[path_table_size] = len;
+      path_table_size += 2;
+
+      set_731(pt_l + path_table_size, dir->extent);
+      set_732(pt_m + path_table_size, dir->extent);
+      path_table_size += 4;
+
+      j = dir->parent ? dir->parent->number : 1;
+      set_721(pt_l + path_table_size, j);
+      set_722(pt_m + path_table_size, j);
+      path_table_size += 2;
+
+      for(j=0; j<len; j++)
+      {
+         pt_l[path_table_size] = dir->name[j];
+         pt_m[path_table_size] = dir->name[j];
+         path_table_size++;
+      }
+      if(path_table_size & 1) path_table_size++;
+   }
+}
+
+static void make_ipd(char *volume_id)
 {
    char iso_time[17];
    int len;
@@ -290,9 +509,9 @@ static void make_ipd()
    ipd.version[0] = 1;
 
    set_str(ipd.system_id,CD_SYSTEM_ID,32);
-   set_str(ipd.volume_id,CD_VOLUME_ID,32);
+   set_str(ipd.volume_id,volume_id,32);
 
-   set_733(ipd.volume_space_size,ISO_FS_BLOCKS);
+   set_733(ipd.volume_space_size,iso_blocks);
    /* we leave ipd.escape_sequences = 0 */
 
    set_723(ipd.volume_set_size,1);
@@ -300,15 +519,15 @@ static void make_ipd()
    set_723(ipd.logical_block_size,2048);
 
    set_733(ipd.path_table_size,path_table_size);
-   set_731(ipd.type_l_path_table,PATH_TABLE_L_EXTENT);
+   set_731(ipd.type_l_path_table,path_table_l.extent);
    set_731(ipd.opt_type_l_path_table,0);
-   set_732(ipd.type_m_path_table,PATH_TABLE_M_EXTENT);
+   set_732(ipd.type_m_path_table,path_table_m.extent);
    set_732(ipd.opt_type_m_path_table,0);
 
    len = 0;
    name[0] = 0;
    add_dirent(ipd.root_directory_record, &len, 34,
-              name, 1, ROOT_DIR_EXTENT, ISO_DIR_SIZE, 2, -1);
+              name, 1, root->extent, root->size, 2, -1);
    if(len!=34)
    {
       fprintf(stderr,"Internal error in make_ipd\n");
@@ -341,80 +560,45 @@ static void make_ipd()
    memcpy(ipd.application_data+141, "CD-XA001", 8);
 }
 
-static void init_iso_dir(char *dir, int *dirlen, int self, int parent)
-{
-   char name[1];
-
-   memset(dir,0,ISO_DIR_SIZE);
-   *dirlen = 0;
-
-   /* add . and .. entries */
-
-   name[0] = 0;
-   add_dirent(dir, dirlen, ISO_DIR_SIZE, name, 1, self,   ISO_DIR_SIZE, 2, 0);
-
-   name[0] = 1;
-   add_dirent(dir, dirlen, ISO_DIR_SIZE, name, 1, parent, ISO_DIR_SIZE, 2, 0);
-}
-
-void add_CDI_dir()
+static void add_CDI_dir()
 {
-   char dir[ISO_DIR_SIZE];
-   int dirlen, len, i;
-
-   cur_dir_extent++;
-
-   if(cur_dir_extent>=150)
-   { fprintf(stderr,"Fatal Error: too many dirs\n"); exit(1); }
-
-   /* Initialize directory */
-
-   init_iso_dir(dir, &dirlen, cur_dir_extent, ROOT_DIR_EXTENT);
-
-   /* Add this directory to root directory */
+   struct iso_node *dir, *file;
 
-   add_dirent(root_dir, &root_dir_len, ISO_DIR_SIZE,
-              "CDI", 3, cur_dir_extent, ISO_DIR_SIZE, 2, 0);
-
-   /* Add files */
+   dir = new_node(root, "CDI", 2);
 
    /* Since this directory is only used for CDI players
       which are hardly in use any more, we add only a bogus file
       CDI_VCD.APP consisting of 0's */
 
-   /* CDI_VCD.APP */
-
-   len = 2048;
-   add_dirent(dir, &dirlen, ISO_DIR_SIZE,
-              "CDI_VCD.APP;1", 13, cur_file_extent, len, 0, 0);
-   for(i=0;i<LEN2BLOCKS(len);i++) output_form1(cur_file_extent++,zero2048);
-
-   /* Output the directory record */
-
-   output_form1(cur_dir_extent,dir);
+   file = new_node(dir, "CDI_VCD.APP;1", 0);
+   file->size   = 2048;
+   file->blocks = 1;
 }
 
-void add_MPEGAV_dir(int num, int *extent, int *size)
+static void add_EXT_dir(int scan_points)
 {
-   char dir[ISO_DIR_SIZE];
-   int dirlen, len, i;
-   char name[32];
+   struct iso_node *dir, *file;
 
-   cur_dir_extent++;
+   dir = new_node(root, "EXT", 2);
 
-   if(cur_dir_extent>=150)
-   { fprintf(stderr,"Fatal Error: too many dirs\n"); exit(1); }
+   /* SCANDATA.DAT lists the sectors of the I frames of all tracks
+      for fast forward and reverse. The blocks for scan_points
+      entries are reserved, the contents are set by vcd_iso_scandata() */
 
-   /* Initialize directory */
-
-   init_iso_dir(dir, &dirlen, cur_dir_extent, ROOT_DIR_EXTENT);
-
-   /* Add this directory to root directory */
+   file = new_node(dir, "SCANDATA.DAT;1", 0);
+   file->size   = 12 + 3*scan_points;
+   file->blocks = LEN2BLOCKS(file->size);
+   file->data   = (char *) iso_alloc(file->blocks*2048);
+   scandata_node = file;
+}
 
-   add_dirent(root_dir, &root_dir_len, ISO_DIR_SIZE,
-              "MPEGAV", 6, cur_dir_extent, ISO_DIR_SIZE, 2, 0);
+static void add_MPEGAV_dir(int num)
+{
+   struct iso_node *dir;
+   char name[32];
+   int i;
 
-   /* Add files */
+   dir = new_node(root, "MPEGAV", 2);
 
    /* RJ:
       This directory contains pointers to the MPEG files
@@ -426,39 +610,21 @@ void add_MPEGAV_dir(int num, int *extent, int *size)
       of sectors muliplied by 2048
    */
 
+   avseq_node = (struct iso_node **) iso_alloc(num*sizeof(struct iso_node *));
 
    for(i=0;i<num;i++)
    {
       sprintf(name,"AVSEQ%2.2d.DAT;1",i+1);
-      add_dirent(dir, &dirlen, ISO_DIR_SIZE,
-                 name, 13, extent[i], size[i]*2048, 0, i+1);
+      avseq_node[i] = new_node(dir, name, 0);
+      avseq_node[i]->xa = i+1;
    }
-
-   /* Output the directory record */
-
-   output_form1(cur_dir_extent,dir);
 }
 
-void add_VCD_dir(int num, int *extent)
+static void add_VCD_dir()
 {
-   char dir[ISO_DIR_SIZE];
-   int dirlen, len, i;
-
-   cur_dir_extent++;
-
-   if(cur_dir_extent>=150)
-   { fprintf(stderr,"Fatal Error: too many dirs\n"); exit(1); }
-
-   /* Initialize directory */
+   struct iso_node *dir, *file;
 
-   init_iso_dir(dir, &dirlen, cur_dir_extent, ROOT_DIR_EXTENT);
-
-   /* Add this directory to root directory */
-
-   add_dirent(root_dir, &root_dir_len, ISO_DIR_SIZE,
-              "VCD", 3, cur_dir_extent, ISO_DIR_SIZE, 2, 0);
-
-   /* Add files */
+   dir = new_node(root, "VCD", 2);
 
    /* RJ:
       I have no description how the files in this directory
@@ -498,112 +664,396 @@ void add_VCD_dir(int num, int *extent)
       This file is optional and not added here!
    */
 
+   file = new_node(dir, "ENTRIES.VCD;1", 0);
+   file->extent = VCD_ENTRIES_EXTENT;
+   file->size   = 2048;
+   file->blocks = 1;
+   file->data   = entries_file;
+   entries_node = file;
+
+   /* The info file is already set */
+
+   file = new_node(dir, "INFO.VCD;1", 0);
+   file->extent = VCD_INFO_EXTENT;
+   file->size   = 2048;
+   file->blocks = 1;
+   file->data   = info_file;
+}
+
+static void iso_name(char *host, int is_dir, char *name)
+{
+   /* Map a file name to an ISO 9660 identifier (level 2):
+      upper case letters, digits and '_' only, at most 30 characters,
+      files get one '.' before the extension and the version ";1" */
+
+   char *ext;
+   int i, n, c, extlen;
+
+   ext = is_dir ? 0 : strrchr(host,'.');
+   if(ext==host) ext = 0;
+
+   extlen = ext ? strlen(ext+1) : 0;
+   if(extlen>10) extlen = 10;
+
+   n = 0;
+   for(i=0; host+i!=ext && host[i] && n<30-extlen; i++)
+   {
+      c = toupper((unsigned char)host[i]);
+      name[n++] = (isalnum(c) && c<0x80) ? c : '_';
+   }
+   if(n==0) name[n++] = '_';
 
-   /* ENTRIES.VCD */
+   if(!is_dir)
+   {
+      name[n++] = '.';
+      for(i=1; i<=extlen; i++)
+      {
+         c = toupper((unsigned char)ext[i]);
+         name[n++] = (isalnum(c) && c<0x80) ? c : '_';
+      }
+      name[n++] = ';';
+      name[n++] = '1';
+   }
+   name[n] = 0;
+}
+
+static void add_host_path(struct iso_node *dir, char *path, int level)
+{
+   /* Add a file or (recursively) a directory of the host file system */
+
+   struct stat st;
+   struct iso_node *node;
+   DIR *d;
+   struct dirent *de;
+   char *base, *sub, name[40];
+
+   if(stat(path,&st)<0)
+   {
+      fprintf(stderr,"Can not add %s\n",path);
+      perror("stat");
+      exit(1);
+   }
+
+   base = strrchr(path,'/');
+   base = (base && base[1]) ? base+1 : path;
+
+   if(!S_ISDIR(st.st_mode))
+   {
+      iso_name(base, 0, name);
+      node = new_node(dir, name, 0);
+      node->size   = st.st_size;
+      node->blocks = LEN2BLOCKS(st.st_size);
+      node->path   = path;
+      return;
+   }
+
+   if(level>=8)
+   {
+      fprintf(stderr,"Fatal Error: %s is nested too deep for ISO 9660\n",path);
+      exit(1);
+   }
+
+   iso_name(base, 1, name);
+   node = new_node(dir, name, 2);
+
+   d = opendir(path);
+   if(d==0)
+   {
+      fprintf(stderr,"Can not add %s\n",path);
+      perror("opendir");
+      exit(1);
+   }
+
+   while((de = readdir(d))!=0)
+   {
+      if(strcmp(de->d_name,".")==0 || strcmp(de->d_name,"..")==0) continue;
+
+      sub = (char *) iso_alloc(strlen(path)+strlen(de->d_name)+2);
+      sprintf(sub,"%s/%s",path,de->d_name);
+      add_host_path(node, sub, level+1);
+   }
+
+   closedir(d);
+}
+
+static void copy_host_file(int rec, struct iso_node *node)
+{
+   /* Copy a file added by the user into the image. Only a chunk of
+      the file is held in memory at a time */
+
+   static char buf[COPY_BLOCKS*2048];
+   FILE *fd;
+   int i, n, nblocks, left;
+
+   fd = fopen(node->path,"rb");
+   if(fd==0)
+   {
+      fprintf(stderr,"Can not open %s\n",node->path);
+      perror("fopen");
+      exit(1);
+   }
+
+   left = node->size;
+
+   while(left>0)
+   {
+      n = (left>sizeof(buf)) ? sizeof(buf) : left;
+
+      if(fread(buf,1,n,fd)!=n)
+      {
+         fprintf(stderr,"Fatal Error: %s changed while writing the image\n",
+                        node->path);
+         exit(1);
+      }
+      left -= n;
+
+      nblocks = LEN2BLOCKS(n);
+      if(n&2047) memset(buf+n, 0, nblocks*2048-n);
+
+      for(i=0;i<nblocks;i++) output_form1(rec++,buf+i*2048);
+   }
+
+   fclose(fd);
+}
+
+static void make_entries_file(int num, struct vcd_entry *entry)
+{
+   int i, m, s, f;
+
+   /* RJ: The entry points as MSF addresses (2 seconds more
+      than the sector number) with the track number in BCD */
 
-   len = 2048;
    memset(entries_file, 0, 2048);
    strncpy(entries_file,"ENTRYVCD",8);
    entries_file[ 8] = 1;
    entries_file[ 9] = 1;
-   entries_file[10] = 0;
-   entries_file[11] = num;
+   entries_file[10] = num>>8;
+   entries_file[11] = num&0xff;
    for(i=0;i<num;i++)
    {
-      int m, s, f;
-
-      f = extent[i]%75;
-      s = extent[i]/75 + 2;
+      f = entry[i].extent%75;
+      s = entry[i].extent/75 + 2;
       m = s/60;
       s = s%60;
-      entries_file[12+4*i  ] = i + 2;
+      entries_file[12+4*i  ] = BCD(entry[i].track);
       entries_file[12+4*i+1] = BCD(m);
       entries_file[12+4*i+2] = BCD(s);
       entries_file[12+4*i+3] = BCD(f);
    }
-   cur_file_extent = 151;
-   add_dirent(dir, &dirlen, ISO_DIR_SIZE,
-              "ENTRIES.VCD;1", 13, cur_file_extent, len, 0, 0);
-   output_form1(cur_file_extent++,entries_file);
-
+}
 
-   /* INFO.VCD */
+static int low_extent, high_extent;
 
-   /* The info file is already set */
-   len = 2048;
-   cur_file_extent = 150;
-   add_dirent(dir, &dirlen, ISO_DIR_SIZE,
-              "INFO.VCD;1", 10, cur_file_extent, len, 0, 0);
-   output_form1(cur_file_extent++,info_file);
+static void alloc_extent(struct iso_node *node)
+{
+   /* Path tables and directories go before the VCD files at block 150
+      if possible, everything else after START_FILE_EXTENT */
 
-   cur_file_extent = 152;
+   if(low_extent+node->blocks<=VCD_INFO_EXTENT)
+   {
+      node->extent = low_extent;
+      low_extent += node->blocks;
+   }
+   else
+   {
+      node->extent = high_extent;
+      high_extent += node->blocks;
+   }
+}
 
-   /* Output the directory record */
+static void alloc_files(struct iso_node *dir)
+{
+   struct iso_node *node;
 
-   output_form1(cur_dir_extent,dir);
+   for(node=dir->child; node; node=node->next)
+   {
+      if(node->flags==2)
+         alloc_files(node);
+      else if(node->extent<0 && (node->blocks>0 || node->path))
+      {
+         node->extent = high_extent;
+         high_extent += node->blocks;
+      }
+   }
 }
 
-void mk_vcd_iso_fs(int num_MPEG_files, int *MPEG_extent, int *MPEG_size)
-{
-   int i;
-   time_t T;
-   /* some initializations */
+/*
+   vcd_iso_layout:
 
-   time(&T);
-   t = gmtime(&T);
+   Build the directory tree for a VCD with num_MPEG_files MPEG tracks
+   and allocate the blocks of all path tables, directories and files.
+   If scan_points is not 0, EXT/SCANDATA.DAT is added with room
+   for that many scan points.
+   The files and directories in path[0] ... path[num_paths-1] are
+   added to the root directory.
 
-   init_iso_dir(root_dir, &root_dir_len, ROOT_DIR_EXTENT, ROOT_DIR_EXTENT);
+   returns the size of the first track (in blocks)
+*/
 
-   cur_dir_extent = ROOT_DIR_EXTENT;
-   cur_file_extent = START_FILE_EXTENT;
+int vcd_iso_layout(int num_MPEG_files, int scan_points, int num_paths, char **path)
+{
+   int i;
 
-   /* set the first 16 blocks to 0 */
+   /* Forget the layout made before */
 
-   for(i=0;i<16;i++) output_form1(i,zero2048);
+   iso_free();
+   entries_node = scandata_node = 0;
 
-   /* Output the data */
+   root = new_node(0, "", 2);
+   root->namelen = 1; /* The root is named by a single 0 byte */
 
    /* RJ: I don't know if the following has to be sorted */
 
    add_CDI_dir();
-   add_MPEGAV_dir(num_MPEG_files, MPEG_extent, MPEG_size);
+   if(scan_points>0) add_EXT_dir(scan_points);
+   add_MPEGAV_dir(num_MPEG_files);
+   add_VCD_dir();
+
+   for(i=0;i<num_paths;i++) add_host_path(root, path[i], 1);
 
-   /* Fill up the end of the iso file system, the VCD directory
-      (which is still to be filled in) is before all others */
+   /* Now the directories and path tables can be sized */
 
-   for(i=cur_file_extent;i<ISO_FS_BLOCKS;i++)
-      output_form1(i,zero2048);
+   collect_dirs();
 
-   /* Add VCD directory */
+   for(i=0;i<num_dirs;i++)
+   {
+      dirs[i]->size   = dir_size(dirs[i]);
+      dirs[i]->blocks = dirs[i]->size/2048;
+   }
 
-   add_VCD_dir(num_MPEG_files, MPEG_extent);
+   path_table_size = 0;
+   for(i=0;i<num_dirs;i++)
+      path_table_size += (8 + dirs[i]->namelen + 1) & ~1;
 
-   /* Fill in the gap beetween VCD directory data and other data */
+   path_table_l.blocks = path_table_m.blocks = LEN2BLOCKS(path_table_size);
+   path_table_l.data = (char *) iso_alloc(path_table_l.blocks*2048);
+   path_table_m.data = (char *) iso_alloc(path_table_m.blocks*2048);
 
-   for(i=cur_file_extent;i<START_FILE_EXTENT;i++)
-      output_form1(i,zero2048);
+   /* Allocate the blocks */
 
-   /* Fill in the gap beetween directories and start of
-      VCD directory data (which is always at sector 150) */
+   low_extent  = FIRST_DIR_EXTENT;
+   high_extent = START_FILE_EXTENT;
 
-   for(i=cur_dir_extent+1;i<150;i++)
-      output_form1(i,zero2048);
+   alloc_extent(&path_table_l);
+   alloc_extent(&path_table_m);
+   for(i=0;i<num_dirs;i++) alloc_extent(dirs[i]);
 
-   /* Create and output path tables */
+   alloc_files(root);
 
-   make_path_tables();
+   iso_blocks = (high_extent>ISO_FS_BLOCKS) ? high_extent : ISO_FS_BLOCKS;
+
+   return iso_blocks;
+}
+
+static int num_written;
+static struct iso_node **written;
+
+static void list_written(struct iso_node *dir)
+{
+   /* List all directories and files with blocks in the first track */
+
+   struct iso_node *node;
+
+   written[num_written++] = dir;
+
+   for(node=dir->child; node; node=node->next)
+   {
+      if(node->flags==2)
+         list_written(node);
+      else if(node->blocks>0)
+         written[num_written++] = node;
+   }
+}
+
+static int count_nodes(struct iso_node *dir)
+{
+   struct iso_node *node;
+   int n = 1;
+
+   for(node=dir->child; node; node=node->next)
+      n += (node->flags==2) ? count_nodes(node) : 1;
+
+   return n;
+}
+
+static int cmp_extent(const void *a, const void *b)
+{
+   return (*(struct iso_node **)a)->extent - (*(struct iso_node **)b)->extent;
+}
+
+/*
+   vcd_iso_scandata:
 
-   output_form1(PATH_TABLE_L_EXTENT,path_table_l);
-   output_form1(PATH_TABLE_M_EXTENT,path_table_m);
+   Set the contents of EXT/SCANDATA.DAT (which must have been reserved
+   by vcd_iso_layout for at least num points) to the MSF addresses
+   of the sectors given.
+*/
 
-   /* Output root directory */
+void vcd_iso_scandata(int num, int *sector)
+{
+   unsigned char *data;
+   int i, m, s, f;
+
+   data = (unsigned char *) scandata_node->data;
+
+   memcpy(data,"SCAN_VCD",8);
+   data[ 8] = 2;  /* version */
+   data[ 9] = 0;
+   data[10] = num>>8;
+   data[11] = num&0xff;
+
+   for(i=0;i<num;i++)
+   {
+      f = sector[i]%75;
+      s = sector[i]/75 + 2;
+      m = s/60;
+      s = s%60;
+      data[12+3*i  ] = BCD(m);
+      data[12+3*i+1] = BCD(s);
+      data[12+3*i+2] = BCD(f);
+   }
+
+   scandata_node->size = 12 + 3*num;
+}
+
+/*
+   mk_vcd_iso_fs:
+
+   Write the first track, vcd_iso_layout must have been called before.
+   MPEG_extent and MPEG_size give the start and size (in blocks)
+   of the MPEG tracks, entry the entry points for ENTRIES.VCD
+   (sorted by sector). All time stamps are set to T.
+*/
+
+void mk_vcd_iso_fs(int num_MPEG_files, int *MPEG_extent, int *MPEG_size,
+                   int num_entries, struct vcd_entry *entry,
+                   char *volume_id, time_t T)
+{
+   int i, j, rec;
+   struct iso_node *node;
+   /* some initializations */
+
+   t = gmtime(&T);
+
+   /* Fill in the MPEG files */
 
-   output_form1(ROOT_DIR_EXTENT, root_dir);
+   for(i=0;i<num_MPEG_files;i++)
+   {
+      avseq_node[i]->extent = MPEG_extent[i];
+      avseq_node[i]->size   = MPEG_size[i]*2048;
+   }
+
+   make_entries_file(num_entries, entry);
+
+   /* Create directories and path tables */
+
+   for(i=0;i<num_dirs;i++) make_dir(dirs[i]);
+
+   make_path_tables();
 
    /* Create ISO Primary desriptor */
 
-   make_ipd();
-   output_form1(16,(char *) &ipd);
+   make_ipd(volume_id);
 
    /* Create end volume descriptor */
 
@@ -616,5 +1066,39 @@ void mk_vcd_iso_fs(int num_MPEG_files, int *MPEG_extent, int *MPEG_size)
    buff2048[4] = '0';
    buff2048[5] = '1';
    buff2048[6] = 0x01;
-   output_form1(17, buff2048);
+
+   /* Output everything in ascending order, unused blocks
+      (the first 16 and the gaps) are filled with 0's */
+
+   written = (struct iso_node **)
+             iso_alloc((count_nodes(root)+2)*sizeof(struct iso_node *));
+   num_written = 0;
+   written[num_written++] = &path_table_l;
+   written[num_written++] = &path_table_m;
+   list_written(root);
+
+   qsort(written, num_written, sizeof(struct iso_node *), cmp_extent);
+
+   for(rec=0;rec<16;rec++) output_form1(rec,zero2048);
+   output_form1(rec++,(char *) &ipd);
+   output_form1(rec++,buff2048);
+
+   for(i=0;i<num_written;i++)
+   {
+      node = written[i];
+
+      for(;rec<node->extent;rec++) output_form1(rec,zero2048);
+
+      if(node->path)
+      {
+         copy_host_file(rec, node);
+         rec += node->blocks;
+         continue;
+      }
+
+      for(j=0;j<node->blocks;j++,rec++)
+         output_form1(rec, node->data ? node->data+j*2048 : zero2048);
+   }
+
+   for(;rec<iso_blocks;rec++) output_form1(rec,zero2048);
 }